@@ -30,6 +30,28 @@
 	#define AADEQUE_VALUE_T void*
 #endif
 
+/* comparison of values, tweakable for value types without == and < */
+#ifndef AADEQUE_EQ
+	#define AADEQUE_EQ(x, y) ((x) == (y))
+#endif
+#ifndef AADEQUE_LT
+	#define AADEQUE_LT(x, y) ((x) < (y))
+#endif
+
+/* prefetching, tweakable; rw is 1 to prefetch for writing, 0 for reading */
+#ifndef AADEQUE_PREFETCH
+	#ifdef __GNUC__
+		#define AADEQUE_PREFETCH(ptr, rw) __builtin_prefetch(ptr, rw)
+	#else
+		#define AADEQUE_PREFETCH(ptr, rw) ((void)(ptr))
+	#endif
+#endif
+
+/* prefetch distance of the iteration functions, in elements, tweakable */
+#ifndef AADEQUE_PREFETCH_DISTANCE
+	#define AADEQUE_PREFETCH_DISTANCE 32
+#endif
+
 /* the type of the lengths and indices */
 #ifndef AADEQUE_SIZE_T
 	#define AADEQUE_SIZE_T unsigned int
@@ -57,6 +79,9 @@ struct AADEQUE_PREFIX {
 	AADEQUE_SIZE_T cap;      /* capacity, actual length of the els array */
 	AADEQUE_SIZE_T off;      /* offset to the first element in els */
 	AADEQUE_SIZE_T len;      /* length */
+	#ifdef AADEQUE_HANDLES
+	AADEQUE_SIZE_T seq;      /* sequence number of the first element */
+	#endif
 	AADEQUE_VALUE_T els[1];  /* elements, allocated in-place */
 };
 
@@ -71,18 +96,35 @@ AADEQUE_NAME(_sizeof)(AADEQUE_SIZE_T cap) {
 	return sizeof(AADEQUE_T) + (cap - 1) * sizeof(AADEQUE_VALUE_T);
 }
 
+/* The masking in aadeque_idx relies on power-of-2 capacities. */
+#if defined(AADEQUE_POW2_CAPACITY) && \
+    (AADEQUE_MIN_CAPACITY & (AADEQUE_MIN_CAPACITY - 1)) != 0
+	#error "AADEQUE_MIN_CAPACITY must be a power of 2"
+#endif
+
 /*
  * Convert external index to internal one. Used internally.
  *
  * i must fulfil i >= 0 and i < length, otherwise the result is undefined.
- * i % cap == i & (cap - 1), since cap always is a power of 2.
+ *
+ * If AADEQUE_POW2_CAPACITY is defined, cap always is a power of 2 and
+ * i % cap == i & (cap - 1). If AADEQUE_BRANCHFREE_IDX is defined, cap is
+ * subtracted using a mask, which can't be compiled to a branch, mispredicted
+ * for random indices. Otherwise, it's up to the compiler.
  */
 static inline AADEQUE_SIZE_T
 AADEQUE_NAME(_idx)(AADEQUE_T *a, AADEQUE_SIZE_T i) {
 	AADEQUE_SIZE_T idx = a->off + i;
+	#if defined(AADEQUE_POW2_CAPACITY)
+	return idx & (a->cap - 1);
+	#elif defined(AADEQUE_BRANCHFREE_IDX)
+	/* The mask is all ones if idx >= cap, otherwise zero. */
+	return idx - (a->cap & -(AADEQUE_SIZE_T)(idx >= a->cap));
+	#else
 	if (idx >= a->cap)
 		idx -= a->cap;
 	return idx;
+	#endif
 }
 
 /*
@@ -90,16 +132,23 @@ AADEQUE_NAME(_idx)(AADEQUE_T *a, AADEQUE_SIZE_T i) {
  */
 static inline AADEQUE_T *
 AADEQUE_NAME(_create)(AADEQUE_SIZE_T len) {
-	AADEQUE_SIZE_T cap = len; //AADEQUE_MIN_CAPACITY;
 	AADEQUE_T *a;
-	//while (cap < len)
-	//	cap = cap << 1;
+	#ifdef AADEQUE_POW2_CAPACITY
+	AADEQUE_SIZE_T cap = AADEQUE_MIN_CAPACITY;
+	while (cap < len)
+		cap = cap << 1;
+	#else
+	AADEQUE_SIZE_T cap = len;
 	if (cap < AADEQUE_MIN_CAPACITY) cap = AADEQUE_MIN_CAPACITY;
+	#endif
 	a = (AADEQUE_T *)AADEQUE_ALLOC(AADEQUE_NAME(_sizeof)(cap));
 	if (!a) AADEQUE_OOM();
 	a->len = len;
 	a->off = 0;
 	a->cap = cap;
+	#ifdef AADEQUE_HANDLES
+	a->seq = 0;
+	#endif
 	return a;
 }
 
@@ -147,6 +196,31 @@ AADEQUE_NAME(_set)(AADEQUE_T *a, AADEQUE_SIZE_T i, AADEQUE_VALUE_T value) {
 	a->els[pos] = value;
 }
 
+/*
+ * Returns a pointer to the element at index i and stores in *spanlen the
+ * number of elements, at most n, that are stored contiguously from there.
+ *
+ * The n elements starting at index i are stored in at most two contiguous
+ * parts. To visit them without copying, call this function again with i and n
+ * advanced by *spanlen:
+ *
+ *   while (n > 0) {
+ *       p = aadeque_span(a, i, n, &k);
+ *       ... use p[0] to p[k-1] ...
+ *       i += k;
+ *       n -= k;
+ *   }
+ *
+ * If i + n is greater than the length of a, the behaviour is undefined.
+ */
+static inline AADEQUE_VALUE_T *
+AADEQUE_NAME(_span)(AADEQUE_T *a, AADEQUE_SIZE_T i, AADEQUE_SIZE_T n,
+                    AADEQUE_SIZE_T *spanlen) {
+	AADEQUE_SIZE_T pos = AADEQUE_NAME(_idx)(a, i);
+	*spanlen = a->cap - pos < n ? a->cap - pos : n;
+	return &a->els[pos];
+}
+
 /*
  * Clear the memory (set to zery bytes) of n elements at indices between
  * i and i+n-1.
@@ -201,6 +275,40 @@ AADEQUE_NAME(_from_array)(AADEQUE_VALUE_T *array, AADEQUE_SIZE_T n) {
 	return a;
 }
 
+/*
+ * Returns 1 if the n values in x and y are equal, 0 otherwise. Uses memcmp if
+ * AADEQUE_MEMCMP is defined. Used internally.
+ */
+static inline int
+AADEQUE_NAME(_eq_values)(AADEQUE_VALUE_T *x, AADEQUE_VALUE_T *y,
+                         AADEQUE_SIZE_T n) {
+	#ifdef AADEQUE_MEMCMP
+	return memcmp(x, y, sizeof(AADEQUE_VALUE_T) * n) == 0;
+	#else
+	AADEQUE_SIZE_T i;
+	for (i = 0; i < n; i++)
+		if (!AADEQUE_EQ(x[i], y[i]))
+			return 0;
+	return 1;
+	#endif
+}
+
+/*
+ * Compares the n values in x and y in order. Returns -1, 0 or 1 if the first
+ * value that differs is less than, equal to or greater than its counterpart.
+ * A single pass, since memcmp's byte order isn't the order of the values.
+ * Used internally.
+ */
+static inline int
+AADEQUE_NAME(_cmp_values)(AADEQUE_VALUE_T *x, AADEQUE_VALUE_T *y,
+                          AADEQUE_SIZE_T n) {
+	AADEQUE_SIZE_T i;
+	for (i = 0; i < n; i++)
+		if (!AADEQUE_EQ(x[i], y[i]))
+			return AADEQUE_LT(x[i], y[i]) ? -1 : 1;
+	return 0;
+}
+
 /*
  * Compare the contents of a against a static C array of n elements. Returns 1
  * if the number of elements is equal to n and all elements are equal to their
@@ -209,15 +317,67 @@ AADEQUE_NAME(_from_array)(AADEQUE_VALUE_T *array, AADEQUE_SIZE_T n) {
 static inline int
 AADEQUE_NAME(_eq_array)(AADEQUE_T *a, AADEQUE_VALUE_T *array,
                         AADEQUE_SIZE_T n) {
-	AADEQUE_SIZE_T i;
+	AADEQUE_SIZE_T i = 0, k;
 	if (a->len != n)
 		return 0;
-	for (i = 0; i < n; i++)
-		if (AADEQUE_NAME(_get)(a, i) != array[i])
+	while (n > 0) {
+		AADEQUE_VALUE_T *p = AADEQUE_NAME(_span)(a, i, n, &k);
+		if (!AADEQUE_NAME(_eq_values)(p, &array[i], k))
+			return 0;
+		i += k;
+		n -= k;
+	}
+	return 1;
+}
+
+/*
+ * Returns 1 if a and b have the same length and all elements are equal to
+ * their counterparts, 0 otherwise.
+ *
+ * The contiguous parts of a and b are compared pairwise, at most three pairs.
+ * If AADEQUE_MEMCMP is defined, the parts are compared using memcmp.
+ */
+static inline int
+AADEQUE_NAME(_eq)(AADEQUE_T *a, AADEQUE_T *b) {
+	AADEQUE_SIZE_T i = 0, n = a->len, ka, kb;
+	if (b->len != n)
+		return 0;
+	while (n > 0) {
+		AADEQUE_VALUE_T *pa = AADEQUE_NAME(_span)(a, i, n, &ka);
+		AADEQUE_VALUE_T *pb = AADEQUE_NAME(_span)(b, i, n, &kb);
+		if (kb < ka)
+			ka = kb;
+		if (!AADEQUE_NAME(_eq_values)(pa, pb, ka))
 			return 0;
+		i += ka;
+		n -= ka;
+	}
 	return 1;
 }
 
+/*
+ * Compares a and b lexicographically, using AADEQUE_LT on the elements.
+ * Returns -1 if a is less than b, 0 if they are equal and 1 if a is greater
+ * than b. A prefix is less than the longer array deque.
+ */
+static inline int
+AADEQUE_NAME(_cmp)(AADEQUE_T *a, AADEQUE_T *b) {
+	AADEQUE_SIZE_T i = 0, n = a->len < b->len ? a->len : b->len, ka, kb;
+	while (n > 0) {
+		AADEQUE_VALUE_T *pa = AADEQUE_NAME(_span)(a, i, n, &ka);
+		AADEQUE_VALUE_T *pb = AADEQUE_NAME(_span)(b, i, n, &kb);
+		int c;
+		if (kb < ka)
+			ka = kb;
+		c = AADEQUE_NAME(_cmp_values)(pa, pb, ka);
+		if (c != 0)
+			return c;
+		i += ka;
+		n -= ka;
+	}
+	return a->len < b->len ? -1 : a->len > b->len ? 1 : 0;
+}
+
 /*----------------------------------------------------------------------------
  * Helpers for growing and compacting the underlying buffer. Like realloc,
  * these functions try to resize the underlying buffer and return a. It there
@@ -256,10 +416,10 @@ AADEQUE_NAME(_reserve)(AADEQUE_T *a, AADEQUE_SIZE_T n) {
 			 */
 			memcpy(&(a->els[a->off + a->cap - oldcap]),
 			       &(a->els[a->off]),
-			       sizeof(AADEQUE_VALUE_T) * (a->cap - oldcap));
+			       sizeof(AADEQUE_VALUE_T) * (oldcap - a->off));
 			#ifdef AADEQUE_CLEAR_UNUSED_MEM
 			memset(&(a->els[a->off]), 0,
-			       sizeof(AADEQUE_VALUE_T) * (a->cap - oldcap));
+			       sizeof(AADEQUE_VALUE_T) * (oldcap - a->off));
 			#endif
 			a->off += a->cap - oldcap;
 		}
@@ -390,6 +550,9 @@ AADEQUE_NAME(_make_space_before)(AADEQUE_T *a, AADEQUE_SIZE_T n) {
 	a = AADEQUE_NAME(_reserve)(a, n);
 	a->off = AADEQUE_NAME(_idx)(a, a->cap - n);
 	a->len += n;
+	#ifdef AADEQUE_HANDLES
+	a->seq -= n;
+	#endif
 	return a;
 }
 
@@ -412,6 +575,9 @@ AADEQUE_NAME(_crop)(AADEQUE_T *a, AADEQUE_SIZE_T offset, AADEQUE_SIZE_T length)
 	#endif
 	a->off = AADEQUE_NAME(_idx)(a, offset);
 	a->len = length;
+	#ifdef AADEQUE_HANDLES
+	a->seq += offset;
+	#endif
 	return AADEQUE_NAME(_compact_some)(a);
 }
 
@@ -431,6 +597,23 @@ AADEQUE_NAME(_delete_first_n)(AADEQUE_T *a, AADEQUE_SIZE_T n) {
 	return AADEQUE_NAME(_crop)(a, n, a->len - n);
 }
 
+/*
+ * Deletes all elements, without reducing the capacity. Useful for a deque that
+ * is repeatedly filled and drained, to avoid reallocating it every time.
+ */
+static inline void
+AADEQUE_NAME(_delete_all)(AADEQUE_T *a) {
+	#ifdef AADEQUE_CLEAR_UNUSED_MEM
+	if (a->len > 0)
+		AADEQUE_NAME(_clear)(a, 0, a->len);
+	#endif
+	#ifdef AADEQUE_HANDLES
+	a->seq += a->len;
+	#endif
+	a->off = 0;
+	a->len = 0;
+}
+
 /*---------------------------------------------------------------------------
  * The pure deque operations: Inserting and deleting values in both ends.
  * Shift, unshift, push, pop.
@@ -509,6 +692,322 @@ AADEQUE_NAME(_prepend)(AADEQUE_T *a1, AADEQUE_T *a2) {
 	return a1;
 }
 
+/*---------------------------------------------------------------------------
+ * Bulk access: fill and copy out ranges of elements, using the contiguous
+ * parts of the buffer instead of one element at a time.
+ *---------------------------------------------------------------------------*/
+
+/*
+ * Sets the n elements starting at index i to value.
+ *
+ * If i + n is greater than the length of a, the behaviour is undefined.
+ */
+static inline void
+AADEQUE_NAME(_fill)(AADEQUE_T *a, AADEQUE_SIZE_T i, AADEQUE_SIZE_T n,
+                    AADEQUE_VALUE_T value) {
+	AADEQUE_SIZE_T j, k;
+	while (n > 0) {
+		AADEQUE_VALUE_T *p = AADEQUE_NAME(_span)(a, i, n, &k);
+		/* A plain loop over contiguous memory, for the compiler to vectorize */
+		for (j = 0; j < k; j++)
+			p[j] = value;
+		i += k;
+		n -= k;
+	}
+}
+
+/*
+ * Copies the n elements starting at index i to dst, which must have room for
+ * n elements. Uses at most two calls to memcpy.
+ *
+ * If i + n is greater than the length of a, the behaviour is undefined.
+ */
+static inline void
+AADEQUE_NAME(_copy_out)(AADEQUE_T *a, AADEQUE_SIZE_T i, AADEQUE_SIZE_T n,
+                        AADEQUE_VALUE_T *dst) {
+	AADEQUE_SIZE_T k;
+	while (n > 0) {
+		AADEQUE_VALUE_T *p = AADEQUE_NAME(_span)(a, i, n, &k);
+		if (k < n)
+			/* The rest is in the beginning of the buffer. */
+			AADEQUE_PREFETCH(&a->els[0], 0);
+		memcpy(dst, p, sizeof(AADEQUE_VALUE_T) * k);
+		dst += k;
+		i += k;
+		n -= k;
+	}
+}
+
+/*
+ * Returns a newly allocated C array with a copy of all the elements, in order,
+ * or NULL if a is empty. Free it using
+ * AADEQUE_FREE(array, sizeof(AADEQUE_VALUE_T) * length).
+ */
+static inline AADEQUE_VALUE_T *
+AADEQUE_NAME(_to_array)(AADEQUE_T *a) {
+	AADEQUE_VALUE_T *array;
+	if (a->len == 0)
+		return NULL;
+	array = (AADEQUE_VALUE_T *)AADEQUE_ALLOC(sizeof(AADEQUE_VALUE_T) * a->len);
+	if (!array) AADEQUE_OOM();
+	AADEQUE_NAME(_copy_out)(a, 0, a->len, array);
+	return array;
+}
+
+/*---------------------------------------------------------------------------
+ * In-place transformations of all elements
+ *---------------------------------------------------------------------------*/
+
+/*
+ * Reverses the order of the elements.
+ *
+ * Elements are swapped between a cursor moving forward from the beginning and
+ * a cursor moving backward from the end. Each round swaps the longest run for
+ * which both cursors stay within a contiguous part of the buffer, so the inner
+ * loop has no index computations.
+ */
+static inline void
+AADEQUE_NAME(_reverse)(AADEQUE_T *a) {
+	AADEQUE_SIZE_T lo = 0, hi = a->len, j, k, kb;
+	while (hi - lo > 1) {
+		AADEQUE_VALUE_T *p = AADEQUE_NAME(_span)(a, lo, (hi - lo) / 2, &k);
+		AADEQUE_VALUE_T *q = &a->els[AADEQUE_NAME(_idx)(a, hi - 1)];
+		kb = (AADEQUE_SIZE_T)(q - a->els) + 1;
+		if (kb < k)
+			k = kb;
+		for (j = 0; j < k; j++) {
+			AADEQUE_VALUE_T tmp = p[j];
+			p[j] = *(q - j);
+			*(q - j) = tmp;
+		}
+		lo += k;
+		hi -= k;
+	}
+}
+
+/*
+ * Replaces each element x with fn(x, ctx).
+ */
+static inline void
+AADEQUE_NAME(_transform)(AADEQUE_T *a,
+                         AADEQUE_VALUE_T (*fn)(AADEQUE_VALUE_T, void *),
+                         void *ctx) {
+	AADEQUE_SIZE_T i = 0, n = a->len, j, k;
+	while (n > 0) {
+		AADEQUE_VALUE_T *p = AADEQUE_NAME(_span)(a, i, n, &k);
+		for (j = 0; j < k; j++)
+			p[j] = fn(p[j], ctx);
+		i += k;
+		n -= k;
+	}
+}
+
+/*
+ * Number of elements per 64-byte cache line, at least 1. Used internally, to
+ * prefetch once per cache line.
+ */
+#define AADEQUE_PER_LINE \
+	(sizeof(AADEQUE_VALUE_T) >= 64 ? 1 : 64 / sizeof(AADEQUE_VALUE_T))
+
+/*
+ * Calls fn(x, ctx) for each of the n elements x starting at index i, in order.
+ * Prefetches the elements AADEQUE_PREFETCH_DISTANCE ahead, within the current
+ * contiguous part of the buffer and, near its end, in the beginning of the
+ * next part, where hardware prefetchers don't look.
+ *
+ * If i + n is greater than the length of a, the behaviour is undefined.
+ */
+static inline void
+AADEQUE_NAME(_each)(AADEQUE_T *a, AADEQUE_SIZE_T i, AADEQUE_SIZE_T n,
+                    void (*fn)(AADEQUE_VALUE_T, void *), void *ctx) {
+	AADEQUE_SIZE_T j, k;
+	while (n > 0) {
+		AADEQUE_VALUE_T *p = AADEQUE_NAME(_span)(a, i, n, &k);
+		for (j = 0; j < k; j++) {
+			if (j % AADEQUE_PER_LINE == 0 && j + AADEQUE_PREFETCH_DISTANCE < n) {
+				if (j + AADEQUE_PREFETCH_DISTANCE < k)
+					AADEQUE_PREFETCH(&p[j + AADEQUE_PREFETCH_DISTANCE], 0);
+				else
+					/* across the wrap, in the next part */
+					AADEQUE_PREFETCH(&a->els[j + AADEQUE_PREFETCH_DISTANCE - k], 0);
+			}
+			fn(p[j], ctx);
+		}
+		i += k;
+		n -= k;
+	}
+}
+
+/*
+ * Like aadeque_each, but also prefetches what the elements point to, half the
+ * prefetch distance ahead, for deques of pointers that fn dereferences. Only
+ * available if AADEQUE_PREFETCH_POINTEE is defined, which requires that
+ * AADEQUE_VALUE_T is a pointer type.
+ */
+#ifdef AADEQUE_PREFETCH_POINTEE
+static inline void
+AADEQUE_NAME(_each_pointee)(AADEQUE_T *a, AADEQUE_SIZE_T i, AADEQUE_SIZE_T n,
+                            void (*fn)(AADEQUE_VALUE_T, void *), void *ctx) {
+	AADEQUE_SIZE_T j, k, d = AADEQUE_PREFETCH_DISTANCE / 2;
+	while (n > 0) {
+		AADEQUE_VALUE_T *p = AADEQUE_NAME(_span)(a, i, n, &k);
+		for (j = 0; j < k; j++) {
+			if (j % AADEQUE_PER_LINE == 0 && j + AADEQUE_PREFETCH_DISTANCE < n) {
+				if (j + AADEQUE_PREFETCH_DISTANCE < k)
+					AADEQUE_PREFETCH(&p[j + AADEQUE_PREFETCH_DISTANCE], 0);
+				else
+					AADEQUE_PREFETCH(&a->els[j + AADEQUE_PREFETCH_DISTANCE - k], 0);
+			}
+			/* The pointer itself was prefetched before. */
+			if (j + d < k)
+				AADEQUE_PREFETCH(p[j + d], 0);
+			else if (j + d < n)
+				AADEQUE_PREFETCH(a->els[j + d - k], 0);
+			fn(p[j], ctx);
+		}
+		i += k;
+		n -= k;
+	}
+}
+#endif
+
+/*
+ * Arithmetic on all elements. Only available if AADEQUE_ARITHMETIC is defined,
+ * which requires that AADEQUE_VALUE_T is an arithmetic type. The loops are
+ * plain loops over the contiguous parts of the buffer, for the compiler to
+ * vectorize.
+ */
+#ifdef AADEQUE_ARITHMETIC
+
+/*
+ * Adds value to each element.
+ */
+static inline void
+AADEQUE_NAME(_add)(AADEQUE_T *a, AADEQUE_VALUE_T value) {
+	AADEQUE_SIZE_T i = 0, n = a->len, j, k;
+	while (n > 0) {
+		AADEQUE_VALUE_T *p = AADEQUE_NAME(_span)(a, i, n, &k);
+		for (j = 0; j < k; j++)
+			p[j] += value;
+		i += k;
+		n -= k;
+	}
+}
+
+/*
+ * Multiplies each element by factor.
+ */
+static inline void
+AADEQUE_NAME(_scale)(AADEQUE_T *a, AADEQUE_VALUE_T factor) {
+	AADEQUE_SIZE_T i = 0, n = a->len, j, k;
+	while (n > 0) {
+		AADEQUE_VALUE_T *p = AADEQUE_NAME(_span)(a, i, n, &k);
+		for (j = 0; j < k; j++)
+			p[j] *= factor;
+		i += k;
+		n -= k;
+	}
+}
+
+/*
+ * Limits each element to the interval from min to max, inclusive.
+ */
+static inline void
+AADEQUE_NAME(_clamp)(AADEQUE_T *a, AADEQUE_VALUE_T min, AADEQUE_VALUE_T max) {
+	AADEQUE_SIZE_T i = 0, n = a->len, j, k;
+	while (n > 0) {
+		AADEQUE_VALUE_T *p = AADEQUE_NAME(_span)(a, i, n, &k);
+		for (j = 0; j < k; j++) {
+			AADEQUE_VALUE_T x = p[j];
+			x = x < min ? min : x;
+			p[j] = x > max ? max : x;
+		}
+		i += k;
+		n -= k;
+	}
+}
+
+/*
+ * Replaces each element with the sum of itself and all elements before it
+ * (inclusive prefix sum). Returns the sum of all elements.
+ */
+static inline AADEQUE_VALUE_T
+AADEQUE_NAME(_inclusive_scan)(AADEQUE_T *a) {
+	AADEQUE_SIZE_T i = 0, n = a->len, j, k;
+	AADEQUE_VALUE_T sum = 0;
+	while (n > 0) {
+		AADEQUE_VALUE_T *p = AADEQUE_NAME(_span)(a, i, n, &k);
+		for (j = 0; j < k; j++)
+			p[j] = sum += p[j];
+		i += k;
+		n -= k;
+	}
+	return sum;
+}
+
+/*
+ * Replaces each element with the sum of all elements before it (exclusive
+ * prefix sum). The first element becomes 0. Returns the sum of all elements.
+ */
+static inline AADEQUE_VALUE_T
+AADEQUE_NAME(_exclusive_scan)(AADEQUE_T *a) {
+	AADEQUE_SIZE_T i = 0, n = a->len, j, k;
+	AADEQUE_VALUE_T sum = 0;
+	while (n > 0) {
+		AADEQUE_VALUE_T *p = AADEQUE_NAME(_span)(a, i, n, &k);
+		for (j = 0; j < k; j++) {
+			AADEQUE_VALUE_T x = p[j];
+			p[j] = sum;
+			sum += x;
+		}
+		i += k;
+		n -= k;
+	}
+	return sum;
+}
+
+/*
+ * Like inclusive_scan, but stores the result in dst, which must have room for
+ * all elements, and leaves a unmodified.
+ */
+static inline AADEQUE_VALUE_T
+AADEQUE_NAME(_inclusive_scan_to)(AADEQUE_T *a, AADEQUE_VALUE_T *dst) {
+	AADEQUE_SIZE_T i = 0, n = a->len, j, k;
+	AADEQUE_VALUE_T sum = 0;
+	while (n > 0) {
+		AADEQUE_VALUE_T *p = AADEQUE_NAME(_span)(a, i, n, &k);
+		for (j = 0; j < k; j++)
+			dst[j] = sum += p[j];
+		dst += k;
+		i += k;
+		n -= k;
+	}
+	return sum;
+}
+
+/*
+ * Like exclusive_scan, but stores the result in dst, which must have room for
+ * all elements, and leaves a unmodified.
+ */
+static inline AADEQUE_VALUE_T
+AADEQUE_NAME(_exclusive_scan_to)(AADEQUE_T *a, AADEQUE_VALUE_T *dst) {
+	AADEQUE_SIZE_T i = 0, n = a->len, j, k;
+	AADEQUE_VALUE_T sum = 0;
+	while (n > 0) {
+		AADEQUE_VALUE_T *p = AADEQUE_NAME(_span)(a, i, n, &k);
+		for (j = 0; j < k; j++) {
+			dst[j] = sum;
+			sum += p[j];
+		}
+		dst += k;
+		i += k;
+		n -= k;
+	}
+	return sum;
+}
+
+#endif
+
 /*---------------------------------------------------------------------------
  * Slice: copy a part of the contents to a new array deque.
  *---------------------------------------------------------------------------*/
@@ -524,15 +1023,71 @@ AADEQUE_NAME(_prepend)(AADEQUE_T *a1, AADEQUE_T *a2) {
 static inline AADEQUE_T *
 AADEQUE_NAME(_slice)(AADEQUE_T *a, AADEQUE_SIZE_T offset, AADEQUE_SIZE_T length) {
 	AADEQUE_T *b = AADEQUE_NAME(_create)(length);
-	/* TODO: use memcpy instead of the loop */
-	AADEQUE_SIZE_T i;
-	for (i = 0; i < length; i++) {
-		AADEQUE_VALUE_T x = AADEQUE_NAME(_get)(a, i + offset);
-		AADEQUE_NAME(_set)(b, i, x);
-	}
+	AADEQUE_NAME(_copy_out)(a, offset, length, b->els);
 	return b;
 }
 
+#ifdef AADEQUE_HANDLES
+/*----------------------------------------------------------------------------
+ * Handles: references to elements which stay valid when the buffer is moved.
+ *
+ * Each element gets a sequence number when it's inserted, one more than the
+ * element before it, and keeps it until it's deleted, no matter how many
+ * elements are inserted or deleted before it. A handle is the sequence number
+ * and a pointer to the variable holding the array deque, so it's still valid
+ * when the array deque is reallocated. The numbers wrap around, which is fine
+ * as long as fewer than 2^N elements (for an N-bit AADEQUE_SIZE_T) are
+ * inserted or deleted in the beginning during the handle's lifetime.
+ *
+ * A handle is valid until its element is deleted. After that, it may refer to
+ * another element inserted in its place. Functions that move elements within
+ * the array deque, such as aadeque_reverse, also change which element a handle
+ * refers to.
+ *----------------------------------------------------------------------------*/
+
+/* A handle to an element */
+struct AADEQUE_NAME(_handle) {
+	AADEQUE_T **aptr;        /* the variable holding the array deque */
+	AADEQUE_SIZE_T seq;      /* the element's sequence number */
+};
+
+/*
+ * Returns a handle to the element at index i in the array deque *aptr.
+ */
+static inline struct AADEQUE_NAME(_handle)
+AADEQUE_NAME(_handle)(AADEQUE_T **aptr, AADEQUE_SIZE_T i) {
+	struct AADEQUE_NAME(_handle) h;
+	h.aptr = aptr;
+	h.seq = (*aptr)->seq + i;
+	return h;
+}
+
+/*
+ * Stores the current index of the element referred to by h in *i. Returns 1
+ * if the element is present, or 0 if it has been deleted from the beginning
+ * or the end.
+ */
+static inline int
+AADEQUE_NAME(_handle_index)(struct AADEQUE_NAME(_handle) h,
+                            AADEQUE_SIZE_T *i) {
+	*i = h.seq - (*h.aptr)->seq;
+	return *i < (*h.aptr)->len;
+}
+
+/*
+ * Returns a pointer to the element referred to by h, or NULL if it has been
+ * deleted from the beginning or the end. The pointer is valid until the array
+ * deque is modified, but the handle can be resolved again.
+ */
+static inline AADEQUE_VALUE_T *
+AADEQUE_NAME(_resolve)(struct AADEQUE_NAME(_handle) h) {
+	AADEQUE_SIZE_T i;
+	if (!AADEQUE_NAME(_handle_index)(h, &i))
+		return NULL;
+	return &(*h.aptr)->els[AADEQUE_NAME(_idx)(*h.aptr, i)];
+}
+#endif
+
 /*----------------------------------------------------------------------------
  * Various, perhaps less useful functions
  *----------------------------------------------------------------------------*/
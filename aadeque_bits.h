@@ -0,0 +1,262 @@
+/*
+ * aadeque_bits.h - A packed bit deque on top of aadeque.h
+ *
+ * The bits are stored 64 per word in an array deque of uint64_t. Bit i of the
+ * deque is bit (bitoff + i) % 64 of word (bitoff + i) / 64, where bitoff is the
+ * position of the first bit within the first word. The words form a ring
+ * buffer exactly like any other struct aadeque, so pushing and shifting bits
+ * and words is amortized O(1).
+ *
+ * This header instantiates aadeque.h with the prefix aadeque_bitwords. The
+ * macros that configure an instantiation, such as AADEQUE_PREFIX and
+ * AADEQUE_ARITHMETIC, are saved before and restored after it, using
+ * aadeque_config_push.h and aadeque_config_pop.h, so your own definitions of
+ * them are unaffected.
+ *
+ * The author disclaims copyright to this source code.
+ */
+#ifndef AADEQUE_BITS_H
+#define AADEQUE_BITS_H
+
+#include <stdint.h>
+
+#include "aadeque_config_push.h"
+#define AADEQUE_PREFIX aadeque_bitwords
+#define AADEQUE_VALUE_T uint64_t
+#define AADEQUE_HEADER \
+	AADEQUE_SIZE_T bitoff;  /* position of the first bit in the first word */ \
+	AADEQUE_SIZE_T nbits;   /* number of bits */
+#include "aadeque.h"
+#include "aadeque_config_pop.h"
+
+/* The bit deque is a word deque with a bit offset and a bit count. */
+typedef struct aadeque_bitwords aadeque_bits_t;
+
+/* A word with the lowest n bits set, for 0 <= n <= 64. Used internally. */
+static inline uint64_t
+aadeque_bits_mask(unsigned n) {
+	return n >= 64 ? ~(uint64_t)0 : ((uint64_t)1 << n) - 1;
+}
+
+/* Number of set bits in a word. Used internally. */
+static inline unsigned
+aadeque_bits_popcount(uint64_t w) {
+	#if defined(__GNUC__)
+	return (unsigned)__builtin_popcountll(w);
+	#else
+	w = w - ((w >> 1) & 0x5555555555555555ULL);
+	w = (w & 0x3333333333333333ULL) + ((w >> 2) & 0x3333333333333333ULL);
+	w = (w + (w >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+	return (unsigned)((w * 0x0101010101010101ULL) >> 56);
+	#endif
+}
+
+/*
+ * Creates an empty bit deque.
+ */
+static inline aadeque_bits_t *
+aadeque_bits_create_empty(void) {
+	aadeque_bits_t *a = aadeque_bitwords_create_empty();
+	a->bitoff = 0;
+	a->nbits = 0;
+	return a;
+}
+
+/*
+ * Frees the memory.
+ */
+static inline void
+aadeque_bits_destroy(aadeque_bits_t *a) {
+	aadeque_bitwords_destroy(a);
+}
+
+/*
+ * Returns the number of bits in the deque.
+ */
+static inline AADEQUE_SIZE_T
+aadeque_bits_len(aadeque_bits_t *a) {
+	return a->nbits;
+}
+
+/*
+ * Fetch the bit (0 or 1) at the zero based index i. The index bounds are not
+ * checked.
+ */
+static inline int
+aadeque_bits_get_bit(aadeque_bits_t *a, AADEQUE_SIZE_T i) {
+	AADEQUE_SIZE_T pos = a->bitoff + i;
+	return (int)((aadeque_bitwords_get(a, pos >> 6) >> (pos & 63)) & 1);
+}
+
+/*
+ * Set (replace) the bit at the zero based index i. Any non-zero value sets the
+ * bit to 1. The index bounds are not checked.
+ */
+static inline void
+aadeque_bits_set_bit(aadeque_bits_t *a, AADEQUE_SIZE_T i, int value) {
+	AADEQUE_SIZE_T pos = a->bitoff + i;
+	uint64_t w = aadeque_bitwords_get(a, pos >> 6);
+	uint64_t bit = (uint64_t)1 << (pos & 63);
+	aadeque_bitwords_set(a, pos >> 6, value ? w | bit : w & ~bit);
+}
+
+/*
+ * Drops the words that no longer contain any bits, in both ends. Used
+ * internally after removing bits.
+ */
+static inline aadeque_bits_t *
+aadeque_bits_trim(aadeque_bits_t *a) {
+	AADEQUE_SIZE_T used;
+	if (a->nbits == 0) {
+		a->bitoff = 0;
+		return aadeque_bitwords_delete_first_n(a, a->len);
+	}
+	if (a->bitoff >= 64) {
+		AADEQUE_SIZE_T n = a->bitoff >> 6;
+		a->bitoff &= 63;
+		a = aadeque_bitwords_delete_first_n(a, n);
+	}
+	used = (a->bitoff + a->nbits + 63) >> 6;
+	if (a->len > used)
+		a = aadeque_bitwords_delete_last_n(a, a->len - used);
+	return a;
+}
+
+/*
+ * Inserts the n lowest bits of w after the last bit, lowest bit first, for
+ * 1 <= n <= 64. Higher bits in w are ignored.
+ * May change aptr if it needs to be reallocated.
+ */
+static inline void
+aadeque_bits_push_bits(aadeque_bits_t **aptr, uint64_t w, unsigned n) {
+	aadeque_bits_t *a = *aptr;
+	AADEQUE_SIZE_T pos = a->bitoff + a->nbits;
+	unsigned sh = pos & 63;
+	w &= aadeque_bits_mask(n);
+	if (sh == 0) {
+		/* Aligned. The bits go into a new word. */
+		a = aadeque_bitwords_make_space_after(a, 1);
+		aadeque_bitwords_set(a, a->len - 1, w);
+	}
+	else {
+		/* Fill up the last word and spill over into a new one if needed. */
+		uint64_t last = aadeque_bitwords_get(a, a->len - 1);
+		last = (last & aadeque_bits_mask(sh)) | (w << sh);
+		aadeque_bitwords_set(a, a->len - 1, last);
+		if (sh + n > 64) {
+			a = aadeque_bitwords_make_space_after(a, 1);
+			aadeque_bitwords_set(a, a->len - 1, w >> (64 - sh));
+		}
+	}
+	a->nbits += n;
+	*aptr = a;
+}
+
+/*
+ * Removes the first n bits, for 1 <= n <= 64, and returns them in the lowest
+ * bits of a word, the first bit being the lowest. The deque must contain at
+ * least n bits.
+ * May change aptr if it needs to be reallocated.
+ */
+static inline uint64_t
+aadeque_bits_shift_bits(aadeque_bits_t **aptr, unsigned n) {
+	aadeque_bits_t *a = *aptr;
+	uint64_t w = aadeque_bitwords_get(a, 0) >> a->bitoff;
+	if (a->bitoff + n > 64)
+		w |= aadeque_bitwords_get(a, 1) << (64 - a->bitoff);
+	w &= aadeque_bits_mask(n);
+	a->bitoff += n;
+	a->nbits -= n;
+	*aptr = aadeque_bits_trim(a);
+	return w;
+}
+
+/*
+ * Inserts 64 bits after the last bit, lowest bit first.
+ * May change aptr if it needs to be reallocated.
+ */
+static inline void
+aadeque_bits_push_word(aadeque_bits_t **aptr, uint64_t w) {
+	aadeque_bits_push_bits(aptr, w, 64);
+}
+
+/*
+ * Removes the first 64 bits and returns them as a word, the first bit being
+ * the lowest. The deque must contain at least 64 bits.
+ * May change aptr if it needs to be reallocated.
+ */
+static inline uint64_t
+aadeque_bits_shift_word(aadeque_bits_t **aptr) {
+	return aadeque_bits_shift_bits(aptr, 64);
+}
+
+/*
+ * Insert a bit at the end.
+ * May change aptr if it needs to be reallocated.
+ */
+static inline void
+aadeque_bits_push_bit(aadeque_bits_t **aptr, int value) {
+	aadeque_bits_push_bits(aptr, value ? 1 : 0, 1);
+}
+
+/*
+ * Remove a bit at the beginning and return it.
+ * May change aptr if it needs to be reallocated.
+ */
+static inline int
+aadeque_bits_shift_bit(aadeque_bits_t **aptr) {
+	return (int)aadeque_bits_shift_bits(aptr, 1);
+}
+
+/*
+ * Insert a bit at the beginning.
+ * May change aptr if it needs to be reallocated.
+ */
+static inline void
+aadeque_bits_unshift_bit(aadeque_bits_t **aptr, int value) {
+	aadeque_bits_t *a = *aptr;
+	if (a->bitoff == 0) {
+		a = aadeque_bitwords_make_space_before(a, 1);
+		aadeque_bitwords_set(a, 0, 0);
+		a->bitoff = 64;
+	}
+	a->bitoff--;
+	a->nbits++;
+	aadeque_bits_set_bit(a, 0, value);
+	*aptr = a;
+}
+
+/*
+ * Remove a bit at the end and return it.
+ * May change aptr if it needs to be reallocated.
+ */
+static inline int
+aadeque_bits_pop_bit(aadeque_bits_t **aptr) {
+	aadeque_bits_t *a = *aptr;
+	int value = aadeque_bits_get_bit(a, a->nbits - 1);
+	a->nbits--;
+	*aptr = aadeque_bits_trim(a);
+	return value;
+}
+
+/*
+ * Returns the number of bits set to 1. The whole words in the middle are
+ * counted using popcount, only the partial words in the ends are masked.
+ */
+static inline AADEQUE_SIZE_T
+aadeque_bits_count(aadeque_bits_t *a) {
+	AADEQUE_SIZE_T i, count = 0, end = a->bitoff + a->nbits;
+	if (a->nbits == 0)
+		return 0;
+	for (i = 0; i < a->len; i++) {
+		uint64_t w = aadeque_bitwords_get(a, i);
+		if (i == 0)
+			w &= ~aadeque_bits_mask(a->bitoff);
+		if (i == a->len - 1 && (end & 63) != 0)
+			w &= aadeque_bits_mask(end & 63);
+		count += aadeque_bits_popcount(w);
+	}
+	return count;
+}
+
+#endif
@@ -0,0 +1,110 @@
+/*
+ * aadeque_bucketq.h - Bucket queue, a monotone priority queue
+ *
+ * A priority queue for integer priorities where the priority of an inserted
+ * element is never less than the priority of the last extracted element and
+ * less than that plus the number of buckets. This is the case for Dijkstra's
+ * algorithm with small integer weights (use max weight + 1 buckets), 0-1 BFS
+ * (2 buckets) and timers with a bounded horizon.
+ *
+ * The buckets form a ring. Each bucket is an array deque, so insert is an
+ * amortized O(1) push and extracting the minimum is an amortized O(1) shift,
+ * plus skipping empty buckets, which is amortized O(1) for monotone use.
+ * Elements with the same priority are extracted in insertion order.
+ *
+ * This header is generic, like aadeque.h. Include it directly after including
+ * aadeque.h. The elements are of type AADEQUE_VALUE_T and the functions get
+ * the same prefix as the array deque.
+ *
+ * The author disclaims copyright to this source code.
+ */
+
+#include <stdint.h>
+
+/* The bucket queue */
+struct AADEQUE_NAME(_bucketq) {
+	AADEQUE_T **buckets;     /* the bucket for priority p is p % nbuckets */
+	AADEQUE_SIZE_T nbuckets;
+	AADEQUE_SIZE_T len;      /* total number of elements */
+	uint64_t min;            /* no element has a lower priority than this */
+};
+
+/*
+ * Creates an empty bucket queue with nbuckets buckets. The priorities of the
+ * elements in the queue must always be within a range of nbuckets.
+ */
+static inline struct AADEQUE_NAME(_bucketq) *
+AADEQUE_NAME(_bucketq_create)(AADEQUE_SIZE_T nbuckets) {
+	struct AADEQUE_NAME(_bucketq) *q = (struct AADEQUE_NAME(_bucketq) *)
+		AADEQUE_ALLOC(sizeof(struct AADEQUE_NAME(_bucketq)));
+	AADEQUE_SIZE_T i;
+	if (!q) AADEQUE_OOM();
+	q->buckets = (AADEQUE_T **)AADEQUE_ALLOC(sizeof(AADEQUE_T *) * nbuckets);
+	if (!q->buckets) AADEQUE_OOM();
+	for (i = 0; i < nbuckets; i++)
+		q->buckets[i] = AADEQUE_NAME(_create_empty)();
+	q->nbuckets = nbuckets;
+	q->len = 0;
+	q->min = 0;
+	return q;
+}
+
+/*
+ * Frees the memory.
+ */
+static inline void
+AADEQUE_NAME(_bucketq_destroy)(struct AADEQUE_NAME(_bucketq) *q) {
+	AADEQUE_SIZE_T i;
+	for (i = 0; i < q->nbuckets; i++)
+		AADEQUE_NAME(_destroy)(q->buckets[i]);
+	AADEQUE_FREE(q->buckets, sizeof(AADEQUE_T *) * q->nbuckets);
+	AADEQUE_FREE(q, sizeof(struct AADEQUE_NAME(_bucketq)));
+}
+
+/*
+ * Returns the number of elements in the queue.
+ */
+static inline AADEQUE_SIZE_T
+AADEQUE_NAME(_bucketq_len)(struct AADEQUE_NAME(_bucketq) *q) {
+	return q->len;
+}
+
+/*
+ * Inserts value with priority prio. If the queue is empty, any priority can
+ * be used. Otherwise, prio must be at least the priority of the last extracted
+ * element and less than that plus the number of buckets. No check is
+ * performed.
+ */
+static inline void
+AADEQUE_NAME(_bucketq_insert)(struct AADEQUE_NAME(_bucketq) *q, uint64_t prio,
+                              AADEQUE_VALUE_T value) {
+	if (q->len == 0 || prio < q->min)
+		q->min = prio;
+	AADEQUE_NAME(_push)(&q->buckets[prio % q->nbuckets], value);
+	q->len++;
+}
+
+/*
+ * Returns the lowest priority of the elements in the queue. The queue must
+ * not be empty.
+ */
+static inline uint64_t
+AADEQUE_NAME(_bucketq_min)(struct AADEQUE_NAME(_bucketq) *q) {
+	while (q->buckets[q->min % q->nbuckets]->len == 0)
+		q->min++;
+	return q->min;
+}
+
+/*
+ * Removes and returns an element with the lowest priority. If prio is not
+ * NULL, the priority is stored in *prio. The queue must not be empty.
+ */
+static inline AADEQUE_VALUE_T
+AADEQUE_NAME(_bucketq_pop_min)(struct AADEQUE_NAME(_bucketq) *q,
+                               uint64_t *prio) {
+	uint64_t min = AADEQUE_NAME(_bucketq_min)(q);
+	if (prio)
+		*prio = min;
+	q->len--;
+	return AADEQUE_NAME(_shift)(&q->buckets[min % q->nbuckets]);
+}
@@ -0,0 +1,299 @@
+/*
+ * aadeque_channel.hpp - Channels for C++20 coroutines
+ *
+ * A bounded channel for passing values between coroutines. co_await
+ * ch.send(x) suspends while the channel is full and co_await ch.recv()
+ * suspends while it is empty. A value sent to a waiting receiver is handed
+ * over directly.
+ *
+ * Suspended coroutines are not resumed from within send or recv. Instead,
+ * they are posted to an executor, which resumes them in batches when run:
+ * the queue of ready coroutines is swapped for an empty one and all of them
+ * are resumed, and then the same for those that became ready meanwhile, until
+ * none is left. This avoids deep recursion and keeps the resumption order
+ * fair (FIFO).
+ *
+ * The values are stored by their bytes in an array deque of bytes, so T must
+ * be trivially copyable, and the waiting coroutines are kept in array deques
+ * of pointers. There is no allocation per value or per suspension in steady
+ * state.
+ *
+ * The Lock template parameter is no_lock by default, for a single-threaded
+ * executor, with no atomics or locks at all. Use std::mutex to share channels
+ * and an executor between threads.
+ *
+ * This header instantiates aadeque.h with the prefixes aadeque_cobytes and
+ * aadeque_coptrs. The macros that configure an instantiation, such as
+ * AADEQUE_PREFIX and AADEQUE_ARITHMETIC, are saved before and restored after
+ * each of them, using aadeque_config_push.h and aadeque_config_pop.h, so your
+ * own definitions of them are unaffected.
+ *
+ * The author disclaims copyright to this source code.
+ */
+#ifndef AADEQUE_CHANNEL_HPP
+#define AADEQUE_CHANNEL_HPP
+
+#include <array>
+#include <bit>
+#include <coroutine>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+
+#include "aadeque_config_push.h"
+#define AADEQUE_PREFIX aadeque_cobytes
+#define AADEQUE_VALUE_T unsigned char
+#include "aadeque.h"
+#include "aadeque_config_pop.h"
+#include "aadeque_config_push.h"
+#define AADEQUE_PREFIX aadeque_coptrs
+#define AADEQUE_VALUE_T void *
+#include "aadeque.h"
+#include "aadeque_config_pop.h"
+
+namespace aadeque_co {
+
+/* A lock that does nothing, for the single-threaded mode */
+struct no_lock {
+	void lock() {}
+	void unlock() {}
+};
+
+/* A coroutine type for coroutines that start immediately and are detached */
+struct task {
+	struct promise_type {
+		task get_return_object() { return task(); }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() { std::terminate(); }
+	};
+};
+
+/* Resumes the coroutines posted to it, in batches */
+template <class Lock = no_lock>
+class basic_executor {
+public:
+	basic_executor()
+		: ready_(aadeque_coptrs_create_empty()),
+		  batch_(aadeque_coptrs_create_empty()) {}
+	~basic_executor() {
+		aadeque_coptrs_destroy(ready_);
+		aadeque_coptrs_destroy(batch_);
+	}
+	basic_executor(const basic_executor &) = delete;
+	basic_executor &operator=(const basic_executor &) = delete;
+
+	/* Makes h ready to be resumed by run(). */
+	void post(std::coroutine_handle<> h) {
+		std::lock_guard<Lock> guard(lock_);
+		aadeque_coptrs_push(&ready_, h.address());
+	}
+
+	/*
+	 * Resumes the ready coroutines, in batches, until none is left. Returns
+	 * the number of coroutines resumed. Only one thread may call this at a
+	 * time.
+	 */
+	std::size_t run() {
+		std::size_t n = 0;
+		for (;;) {
+			{
+				std::lock_guard<Lock> guard(lock_);
+				std::swap(ready_, batch_);
+			}
+			if (batch_->len == 0)
+				return n;
+			for (AADEQUE_SIZE_T i = 0; i < batch_->len; i++)
+				std::coroutine_handle<>::from_address(
+					aadeque_coptrs_get(batch_, i)).resume();
+			n += batch_->len;
+			aadeque_coptrs_delete_all(batch_);
+		}
+	}
+
+private:
+	struct aadeque_coptrs *ready_;  /* posted since the last batch */
+	struct aadeque_coptrs *batch_;  /* the batch being resumed */
+	Lock lock_;
+};
+
+typedef basic_executor<> executor;
+
+/* A bounded channel of values of type T */
+template <class T, class Lock = no_lock>
+class channel {
+	static_assert(std::is_trivially_copyable<T>::value,
+	              "the values are stored by their bytes");
+public:
+	class send_awaiter;
+	class recv_awaiter;
+
+	/*
+	 * Creates a channel with room for cap values, where the suspended
+	 * coroutines are resumed by ex. If cap is 0, each send waits for a recv.
+	 */
+	channel(basic_executor<Lock> &ex, std::size_t cap)
+		: ex_(ex), cap_(cap), len_(0), closed_(false),
+		  buf_(aadeque_cobytes_create_empty()),
+		  senders_(aadeque_coptrs_create_empty()),
+		  receivers_(aadeque_coptrs_create_empty()) {}
+	~channel() {
+		aadeque_cobytes_destroy(buf_);
+		aadeque_coptrs_destroy(senders_);
+		aadeque_coptrs_destroy(receivers_);
+	}
+	channel(const channel &) = delete;
+	channel &operator=(const channel &) = delete;
+
+	/* Returns the number of values in the channel. */
+	std::size_t size() {
+		std::lock_guard<Lock> guard(lock_);
+		return len_;
+	}
+
+	/*
+	 * co_await ch.send(x) sends x, suspending while the channel is full.
+	 * Returns false if the channel is closed.
+	 */
+	send_awaiter send(const T &value) { return send_awaiter(*this, value); }
+
+	/*
+	 * co_await ch.recv() receives a value, suspending while the channel is
+	 * empty. Returns an empty optional if the channel is closed and empty.
+	 */
+	recv_awaiter recv() { return recv_awaiter(*this); }
+
+	/*
+	 * Closes the channel. The waiting senders fail and the waiting receivers
+	 * get an empty optional. Values already in the channel can be received.
+	 */
+	void close() {
+		std::lock_guard<Lock> guard(lock_);
+		closed_ = true;
+		while (senders_->len > 0) {
+			send_awaiter *s =
+				static_cast<send_awaiter *>(aadeque_coptrs_shift(&senders_));
+			s->ok_ = false;
+			ex_.post(s->h_);
+		}
+		while (receivers_->len > 0)
+			ex_.post(static_cast<recv_awaiter *>(
+				aadeque_coptrs_shift(&receivers_))->h_);
+	}
+
+	class send_awaiter {
+	public:
+		bool await_ready() { return false; }
+		bool await_suspend(std::coroutine_handle<> h) {
+			std::lock_guard<Lock> guard(ch_.lock_);
+			if (ch_.closed_) {
+				ok_ = false;
+				return false;
+			}
+			if (ch_.receivers_->len > 0) {
+				/* Hand over the value to a waiting receiver. */
+				recv_awaiter *r = static_cast<recv_awaiter *>(
+					aadeque_coptrs_shift(&ch_.receivers_));
+				r->value_ = value_;
+				ch_.ex_.post(r->h_);
+				return false;
+			}
+			if (ch_.len_ < ch_.cap_) {
+				ch_.put(value_);
+				return false;
+			}
+			h_ = h;
+			aadeque_coptrs_push(&ch_.senders_, this);
+			return true;
+		}
+		bool await_resume() { return ok_; }
+	private:
+		friend class channel;
+		send_awaiter(channel &ch, const T &value)
+			: ch_(ch), value_(value), ok_(true) {}
+		channel &ch_;
+		T value_;
+		bool ok_;
+		std::coroutine_handle<> h_;
+	};
+
+	class recv_awaiter {
+	public:
+		bool await_ready() { return false; }
+		bool await_suspend(std::coroutine_handle<> h) {
+			std::lock_guard<Lock> guard(ch_.lock_);
+			if (ch_.len_ > 0) {
+				value_ = ch_.take();
+				/* Make room for a waiting sender. */
+				if (ch_.senders_->len > 0) {
+					send_awaiter *s = static_cast<send_awaiter *>(
+						aadeque_coptrs_shift(&ch_.senders_));
+					ch_.put(s->value_);
+					ch_.ex_.post(s->h_);
+				}
+				return false;
+			}
+			if (ch_.senders_->len > 0) {
+				/* Unbuffered. Take the value from a waiting sender. */
+				send_awaiter *s = static_cast<send_awaiter *>(
+					aadeque_coptrs_shift(&ch_.senders_));
+				value_ = s->value_;
+				ch_.ex_.post(s->h_);
+				return false;
+			}
+			if (ch_.closed_)
+				return false;
+			h_ = h;
+			aadeque_coptrs_push(&ch_.receivers_, this);
+			return true;
+		}
+		std::optional<T> await_resume() { return value_; }
+	private:
+		friend class channel;
+		explicit recv_awaiter(channel &ch) : ch_(ch) {}
+		channel &ch_;
+		std::optional<T> value_;
+		std::coroutine_handle<> h_;
+	};
+
+private:
+	/* Appends the bytes of value to the buffer. */
+	void put(const T &value) {
+		const unsigned char *src =
+			reinterpret_cast<const unsigned char *>(&value);
+		AADEQUE_SIZE_T i = buf_->len, n = sizeof(T), k;
+		buf_ = aadeque_cobytes_make_space_after(buf_, sizeof(T));
+		while (n > 0) {
+			unsigned char *p = aadeque_cobytes_span(buf_, i, n, &k);
+			std::memcpy(p, src, k);
+			src += k;
+			i += k;
+			n -= k;
+		}
+		len_++;
+	}
+
+	/* Removes the first value from the buffer and returns it. */
+	T take() {
+		std::array<unsigned char, sizeof(T)> bytes;
+		aadeque_cobytes_copy_out(buf_, 0, sizeof(T), bytes.data());
+		buf_ = aadeque_cobytes_delete_first_n(buf_, sizeof(T));
+		len_--;
+		return std::bit_cast<T>(bytes);
+	}
+
+	basic_executor<Lock> &ex_;
+	std::size_t cap_, len_;
+	bool closed_;
+	struct aadeque_cobytes *buf_;       /* the values, as bytes */
+	struct aadeque_coptrs *senders_;    /* waiting send_awaiters */
+	struct aadeque_coptrs *receivers_;  /* waiting recv_awaiters */
+	Lock lock_;
+};
+
+} /* namespace aadeque_co */
+
+#endif
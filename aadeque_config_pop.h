@@ -0,0 +1,20 @@
+/*
+ * aadeque_config_pop.h - Restores the macros saved by aadeque_config_push.h
+ *
+ * Used internally, after an instantiation of aadeque.h. See
+ * aadeque_config_push.h.
+ *
+ * The author disclaims copyright to this source code.
+ */
+
+#pragma pop_macro("AADEQUE_PREFIX")
+#pragma pop_macro("AADEQUE_VALUE_T")
+#pragma pop_macro("AADEQUE_HEADER")
+#pragma pop_macro("AADEQUE_EQ")
+#pragma pop_macro("AADEQUE_LT")
+#pragma pop_macro("AADEQUE_MEMCMP")
+#pragma pop_macro("AADEQUE_ARITHMETIC")
+#pragma pop_macro("AADEQUE_HANDLES")
+#pragma pop_macro("AADEQUE_PREFETCH_POINTEE")
+#pragma pop_macro("AADEQUE_POW2_CAPACITY")
+#pragma pop_macro("AADEQUE_BRANCHFREE_IDX")
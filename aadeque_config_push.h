@@ -0,0 +1,48 @@
+/*
+ * aadeque_config_push.h - Saves and resets the macros of an instantiation
+ *
+ * Used internally by the headers that instantiate aadeque.h for their own
+ * use, around each such instantiation:
+ *
+ *     #include "aadeque_config_push.h"
+ *     #define AADEQUE_PREFIX aadeque_something
+ *     #define AADEQUE_VALUE_T something
+ *     #include "aadeque.h"
+ *     #include "aadeque_config_pop.h"
+ *
+ * It saves and undefines the macros that configure a single instantiation,
+ * so the internal instantiation gets the defaults instead of the user's
+ * settings, and aadeque_config_pop.h restores them afterwards, so the user's
+ * own definitions are unaffected. The allocation macros, AADEQUE_SIZE_T,
+ * AADEQUE_MIN_CAPACITY and AADEQUE_CLEAR_UNUSED_MEM are left alone and apply to
+ * the internal instantiations too.
+ *
+ * Uses #pragma push_macro, which GCC, Clang and MSVC support. No include
+ * guard, since it's included once per instantiation.
+ *
+ * The author disclaims copyright to this source code.
+ */
+
+#pragma push_macro("AADEQUE_PREFIX")
+#pragma push_macro("AADEQUE_VALUE_T")
+#pragma push_macro("AADEQUE_HEADER")
+#pragma push_macro("AADEQUE_EQ")
+#pragma push_macro("AADEQUE_LT")
+#pragma push_macro("AADEQUE_MEMCMP")
+#pragma push_macro("AADEQUE_ARITHMETIC")
+#pragma push_macro("AADEQUE_HANDLES")
+#pragma push_macro("AADEQUE_PREFETCH_POINTEE")
+#pragma push_macro("AADEQUE_POW2_CAPACITY")
+#pragma push_macro("AADEQUE_BRANCHFREE_IDX")
+
+#undef AADEQUE_PREFIX
+#undef AADEQUE_VALUE_T
+#undef AADEQUE_HEADER
+#undef AADEQUE_EQ
+#undef AADEQUE_LT
+#undef AADEQUE_MEMCMP
+#undef AADEQUE_ARITHMETIC
+#undef AADEQUE_HANDLES
+#undef AADEQUE_PREFETCH_POINTEE
+#undef AADEQUE_POW2_CAPACITY
+#undef AADEQUE_BRANCHFREE_IDX
@@ -0,0 +1,244 @@
+/*
+ * aadeque_delta.h - A compressed deque of non-decreasing integers
+ *
+ * Useful for timestamps, offsets and other monotonic sequences. The values
+ * are stored in blocks. Each block stores its first value as is, followed by
+ * the differences between consecutive values encoded as LEB128 varints, so
+ * small steps take a single byte instead of eight.
+ *
+ * The blocks are kept in an array deque of block pointers. Values are pushed
+ * at the end and shifted from the beginning in amortized O(1). A block is
+ * freed as soon as all its values have been shifted. Random access is done by
+ * a binary search over the blocks followed by decoding within one block.
+ *
+ * The values pushed must be non-decreasing, otherwise the behaviour is
+ * undefined. No check is performed. The number of values and the indices are
+ * 64 bit, so the number of values is not limited by AADEQUE_SIZE_T, only the
+ * number of blocks.
+ *
+ * This header instantiates aadeque.h with the prefix aadeque_deltablocks. The
+ * macros that configure an instantiation, such as AADEQUE_PREFIX and
+ * AADEQUE_ARITHMETIC, are saved before and restored after it, using
+ * aadeque_config_push.h and aadeque_config_pop.h, so your own definitions of
+ * them are unaffected.
+ *
+ * The author disclaims copyright to this source code.
+ */
+#ifndef AADEQUE_DELTA_H
+#define AADEQUE_DELTA_H
+
+#include <stdint.h>
+
+/*
+ * The number of bytes for varints in each block, tweakable. A block holds at
+ * most one value more than this, which must fit the unsigned short counters.
+ */
+#ifndef AADEQUE_DELTA_BLOCK_BYTES
+	#define AADEQUE_DELTA_BLOCK_BYTES 240
+#endif
+#if AADEQUE_DELTA_BLOCK_BYTES > 65534
+	#error "AADEQUE_DELTA_BLOCK_BYTES must be at most 65534"
+#endif
+
+/* A varint of a 64 bit integer takes up to 10 bytes */
+#define AADEQUE_DELTA_VARINT_MAX 10
+
+struct aadeque_delta_block;
+
+#include "aadeque_config_push.h"
+#define AADEQUE_PREFIX aadeque_deltablocks
+#define AADEQUE_VALUE_T struct aadeque_delta_block *
+#define AADEQUE_HEADER \
+	uint64_t nvals;          /* number of values */ \
+	AADEQUE_SIZE_T head;     /* index of the first value in the first block */ \
+	AADEQUE_SIZE_T headpos;  /* position of the varint after the first value */ \
+	uint64_t headval;        /* the first value */
+#include "aadeque.h"
+#include "aadeque_config_pop.h"
+
+/* A block of delta-encoded values */
+struct aadeque_delta_block {
+	uint64_t first;        /* the first value, stored as is */
+	uint64_t last;         /* the last value, for computing the next delta */
+	uint64_t seq;          /* sequence number of the first value */
+	unsigned short count;  /* number of values in the block */
+	unsigned short nbytes; /* number of used bytes */
+	unsigned char bytes[AADEQUE_DELTA_BLOCK_BYTES]; /* the deltas, as varints */
+};
+
+/* The compressed deque is a deque of blocks with some extra members. */
+typedef struct aadeque_deltablocks aadeque_delta_t;
+
+/* Writes x as a varint at p. Returns the number of bytes written. */
+static inline unsigned
+aadeque_delta_put_varint(unsigned char *p, uint64_t x) {
+	unsigned n = 0;
+	while (x >= 0x80) {
+		p[n++] = (unsigned char)(x | 0x80);
+		x >>= 7;
+	}
+	p[n++] = (unsigned char)x;
+	return n;
+}
+
+/* Reads a varint at p into *x. Returns the number of bytes read. */
+static inline unsigned
+aadeque_delta_get_varint(const unsigned char *p, uint64_t *x) {
+	uint64_t v = 0;
+	unsigned n = 0, shift = 0;
+	do {
+		v |= (uint64_t)(p[n] & 0x7f) << shift;
+		shift += 7;
+	} while (p[n++] & 0x80);
+	*x = v;
+	return n;
+}
+
+/*
+ * Creates an empty compressed deque.
+ */
+static inline aadeque_delta_t *
+aadeque_delta_create_empty(void) {
+	aadeque_delta_t *a = aadeque_deltablocks_create_empty();
+	a->nvals = 0;
+	a->head = 0;
+	a->headpos = 0;
+	a->headval = 0;
+	return a;
+}
+
+/*
+ * Frees the memory, including all blocks.
+ */
+static inline void
+aadeque_delta_destroy(aadeque_delta_t *a) {
+	AADEQUE_SIZE_T i;
+	for (i = 0; i < a->len; i++)
+		AADEQUE_FREE(aadeque_deltablocks_get(a, i),
+		             sizeof(struct aadeque_delta_block));
+	aadeque_deltablocks_destroy(a);
+}
+
+/*
+ * Returns the number of values.
+ */
+static inline uint64_t
+aadeque_delta_len(aadeque_delta_t *a) {
+	return a->nvals;
+}
+
+/*
+ * Insert a value at the end. It must be greater than or equal to the last
+ * value.
+ * May change aptr if it needs to be reallocated.
+ */
+static inline void
+aadeque_delta_push(aadeque_delta_t **aptr, uint64_t value) {
+	aadeque_delta_t *a = *aptr;
+	struct aadeque_delta_block *b = NULL;
+	if (a->len > 0)
+		b = aadeque_deltablocks_get(a, a->len - 1);
+	if (b && b->nbytes + AADEQUE_DELTA_VARINT_MAX <= AADEQUE_DELTA_BLOCK_BYTES) {
+		/* Append the delta to the last block. */
+		b->nbytes += aadeque_delta_put_varint(&b->bytes[b->nbytes],
+		                                      value - b->last);
+		b->last = value;
+		b->count++;
+	}
+	else {
+		/* Start a new block. */
+		struct aadeque_delta_block *nb = (struct aadeque_delta_block *)
+			AADEQUE_ALLOC(sizeof(struct aadeque_delta_block));
+		if (!nb) AADEQUE_OOM();
+		nb->first = nb->last = value;
+		nb->seq = b ? b->seq + b->count : 0;
+		nb->count = 1;
+		nb->nbytes = 0;
+		aadeque_deltablocks_push(&a, nb);
+		if (a->len == 1) {
+			a->head = 0;
+			a->headpos = 0;
+			a->headval = value;
+		}
+	}
+	a->nvals++;
+	*aptr = a;
+}
+
+/*
+ * Returns the first value without removing it. The deque must not be empty.
+ */
+static inline uint64_t
+aadeque_delta_first(aadeque_delta_t *a) {
+	return a->headval;
+}
+
+/*
+ * Remove a value at the beginning and return it. When the last value of a
+ * block is removed, the whole block is dropped.
+ * May change aptr if it needs to be reallocated.
+ */
+static inline uint64_t
+aadeque_delta_shift(aadeque_delta_t **aptr) {
+	aadeque_delta_t *a = *aptr;
+	struct aadeque_delta_block *b = aadeque_deltablocks_get(a, 0);
+	uint64_t value = a->headval;
+	a->nvals--;
+	if (++a->head == b->count) {
+		AADEQUE_FREE(aadeque_deltablocks_shift(&a),
+		             sizeof(struct aadeque_delta_block));
+		a->head = 0;
+		a->headpos = 0;
+		if (a->len > 0)
+			a->headval = aadeque_deltablocks_get(a, 0)->first;
+	}
+	else {
+		uint64_t delta;
+		a->headpos += aadeque_delta_get_varint(&b->bytes[a->headpos], &delta);
+		a->headval += delta;
+	}
+	*aptr = a;
+	return value;
+}
+
+/*
+ * Fetch the value at the zero based index i. The index bounds are not checked.
+ *
+ * Finds the block by binary search over the blocks, O(log n), and then decodes
+ * the deltas within the block from its beginning.
+ */
+static inline uint64_t
+aadeque_delta_get(aadeque_delta_t *a, uint64_t i) {
+	struct aadeque_delta_block *b = aadeque_deltablocks_get(a, 0);
+	uint64_t seq0 = b->seq, target = a->head + i, j;
+	AADEQUE_SIZE_T pos;
+	uint64_t value, delta;
+	AADEQUE_SIZE_T lo = 0, hi = a->len;
+	/* Find the last block whose first value is at or before target. */
+	while (hi - lo > 1) {
+		AADEQUE_SIZE_T mid = lo + (hi - lo) / 2;
+		if (aadeque_deltablocks_get(a, mid)->seq - seq0 <= target)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	if (lo == 0) {
+		/* Start from the first value, which is already decoded. */
+		j = a->head;
+		pos = a->headpos;
+		value = a->headval;
+	}
+	else {
+		b = aadeque_deltablocks_get(a, lo);
+		j = 0;
+		pos = 0;
+		value = b->first;
+	}
+	for (; j < target - (b->seq - seq0); j++) {
+		pos += aadeque_delta_get_varint(&b->bytes[pos], &delta);
+		value += delta;
+	}
+	return value;
+}
+
+#endif
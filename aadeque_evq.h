@@ -0,0 +1,166 @@
+/*
+ * aadeque_evq.h - A queue with a pollable file descriptor, for event loops
+ *
+ * Producer threads push values to an array deque protected by a mutex. The
+ * consumer, an event loop, polls a file descriptor (an eventfd on Linux, the
+ * read end of a pipe elsewhere) that becomes readable when there are values
+ * in the queue. It is only written to when a push makes the queue non-empty,
+ * not once per value, so a burst of pushes costs one system call.
+ *
+ * When the file descriptor is readable, the consumer takes all the values in
+ * one batch by swapping the queue's array deque for an empty one, so values
+ * are not copied and the capacity of both deques is reused. It resets the file
+ * descriptor before swapping, so a push that makes the queue non-empty again
+ * after the swap always signals. (A push just before the swap may cause a
+ * wakeup for a queue that has already been drained.)
+ *
+ * This header is generic, like aadeque.h. Include it directly after including
+ * aadeque.h and the functions get the same prefix. Requires POSIX threads.
+ *
+ * The author disclaims copyright to this source code.
+ */
+
+#ifndef AADEQUE_EVQ_COMMON
+#define AADEQUE_EVQ_COMMON
+
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#ifdef __linux__
+	#include <sys/eventfd.h>
+#endif
+
+/*
+ * Creates the file descriptors in fds. fds[0] is polled and read and fds[1]
+ * is written. Returns 0 on success and -1 on error. Used internally.
+ */
+static inline int
+aadeque_evq_open(int fds[2]) {
+#ifdef __linux__
+	fds[0] = fds[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	return fds[0] < 0 ? -1 : 0;
+#else
+	if (pipe(fds) < 0)
+		return -1;
+	fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+	fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+	fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+	fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+	return 0;
+#endif
+}
+
+static inline void
+aadeque_evq_close(int fds[2]) {
+	close(fds[0]);
+	if (fds[1] != fds[0])
+		close(fds[1]);
+}
+
+/* Makes fds[0] readable. Used internally. */
+static inline void
+aadeque_evq_signal(int fds[2]) {
+	uint64_t one = 1;
+	ssize_t r;
+	/* Can only fail if already readable, so the result is ignored. */
+#ifdef __linux__
+	r = write(fds[1], &one, sizeof(one));
+#else
+	r = write(fds[1], &one, 1);
+#endif
+	(void)r;
+}
+
+/* Makes fds[0] non-readable. Used internally. */
+static inline void
+aadeque_evq_reset(int fds[2]) {
+	uint64_t buf[8];
+#ifdef __linux__
+	ssize_t r = read(fds[0], buf, sizeof(uint64_t));
+	(void)r;
+#else
+	while (read(fds[0], buf, sizeof(buf)) > 0)
+		;
+#endif
+}
+
+#endif
+
+/* The queue */
+struct AADEQUE_NAME(_evq) {
+	pthread_mutex_t lock;
+	AADEQUE_T *q;
+	int fds[2];
+};
+
+/*
+ * Creates an empty queue. Returns NULL if the file descriptor can't be
+ * created, with errno set.
+ */
+static inline struct AADEQUE_NAME(_evq) *
+AADEQUE_NAME(_evq_create)(void) {
+	struct AADEQUE_NAME(_evq) *e = (struct AADEQUE_NAME(_evq) *)
+		AADEQUE_ALLOC(sizeof(struct AADEQUE_NAME(_evq)));
+	if (!e) AADEQUE_OOM();
+	if (aadeque_evq_open(e->fds) < 0) {
+		AADEQUE_FREE(e, sizeof(struct AADEQUE_NAME(_evq)));
+		return NULL;
+	}
+	pthread_mutex_init(&e->lock, NULL);
+	e->q = AADEQUE_NAME(_create_empty)();
+	return e;
+}
+
+/*
+ * Closes the file descriptor and frees the memory. Values left in the queue
+ * are discarded.
+ */
+static inline void
+AADEQUE_NAME(_evq_destroy)(struct AADEQUE_NAME(_evq) *e) {
+	aadeque_evq_close(e->fds);
+	pthread_mutex_destroy(&e->lock);
+	AADEQUE_NAME(_destroy)(e->q);
+	AADEQUE_FREE(e, sizeof(struct AADEQUE_NAME(_evq)));
+}
+
+/*
+ * Returns the file descriptor to poll for readability. Don't read from it.
+ */
+static inline int
+AADEQUE_NAME(_evq_fd)(struct AADEQUE_NAME(_evq) *e) {
+	return e->fds[0];
+}
+
+/*
+ * Inserts a value at the end of the queue. Signals the file descriptor if the
+ * queue was empty. Any thread may call this.
+ */
+static inline void
+AADEQUE_NAME(_evq_push)(struct AADEQUE_NAME(_evq) *e, AADEQUE_VALUE_T value) {
+	int was_empty;
+	pthread_mutex_lock(&e->lock);
+	was_empty = e->q->len == 0;
+	AADEQUE_NAME(_push)(&e->q, value);
+	pthread_mutex_unlock(&e->lock);
+	if (was_empty)
+		aadeque_evq_signal(e->fds);
+}
+
+/*
+ * Takes all values in the queue by swapping them with the values in *batch,
+ * which should be empty, typically the batch from the previous call after
+ * aadeque_delete_all(). Resets the file descriptor. Returns the number of
+ * values taken. Call it when the file descriptor is readable.
+ */
+static inline AADEQUE_SIZE_T
+AADEQUE_NAME(_evq_drain)(struct AADEQUE_NAME(_evq) *e, AADEQUE_T **batch) {
+	AADEQUE_T *q;
+	aadeque_evq_reset(e->fds);
+	pthread_mutex_lock(&e->lock);
+	q = e->q;
+	e->q = *batch;
+	pthread_mutex_unlock(&e->lock);
+	*batch = q;
+	return q->len;
+}
@@ -0,0 +1,274 @@
+/*
+ * aadeque_forkjoin.h - A small fork-join runtime with work stealing
+ *
+ * A pool of workers, each with a work-stealing deque (aadeque_ws.h) of tasks.
+ * A task forks a child task by pushing it onto its worker's own deque and
+ * joins it by waiting until it is done. While waiting, the worker runs tasks
+ * from the bottom of its own deque (usually the child itself, so most forks
+ * cost no more than a push and a pop) or steals from the top of the deque of
+ * a randomly chosen worker. Thieves thus take the oldest, and typically the
+ * largest, tasks.
+ *
+ * Idle workers steal for a while and then park. On Linux they sleep on a
+ * futex, which a fork only wakes if some worker is parked. On other systems
+ * they yield instead.
+ *
+ * The tasks are owned by the caller, typically on the stack of the forking
+ * task, and embed a struct aadeque_fj_task as their first member.
+ *
+ * Requires C11 atomics and POSIX threads. On Linux, syscall() must be
+ * declared, so with a strict -std, define _DEFAULT_SOURCE before including
+ * any system header.
+ *
+ * The author disclaims copyright to this source code.
+ */
+#ifndef AADEQUE_FORKJOIN_H
+#define AADEQUE_FORKJOIN_H
+
+#include "aadeque_ws.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <limits.h>
+#ifdef __linux__
+	#include <linux/futex.h>
+	#include <sys/syscall.h>
+	#include <unistd.h>
+#endif
+
+/* Number of steal rounds before an idle worker parks, tweakable */
+#ifndef AADEQUE_FJ_SPINS
+	#define AADEQUE_FJ_SPINS 64
+#endif
+
+struct aadeque_fj_worker;
+
+/* A task. Embed it as the first member of your own task struct. */
+struct aadeque_fj_task {
+	void (*fn)(struct aadeque_fj_task *, struct aadeque_fj_worker *);
+	atomic_int done;
+};
+
+/* A worker. Worker 0 is the thread calling aadeque_fj_run(). */
+struct aadeque_fj_worker {
+	aadeque_ws_t *deque;
+	struct aadeque_fj_pool *pool;
+	unsigned id;
+	uint32_t rng;                   /* state for choosing victims */
+	pthread_t thread;
+};
+
+/* The pool of workers */
+typedef struct aadeque_fj_pool {
+	unsigned nworkers;
+	struct aadeque_fj_worker *workers;
+	atomic_uint epoch;              /* futex word, bumped to wake workers */
+	atomic_int sleepers;            /* number of parked workers */
+	atomic_int stop;
+} aadeque_fj_pool_t;
+
+/* Parks the calling worker while the epoch is e. Used internally. */
+static inline void
+aadeque_fj_park(aadeque_fj_pool_t *p, unsigned e) {
+#ifdef __linux__
+	/* atomic_uint has the size and representation of a futex word here */
+	syscall(SYS_futex, (unsigned *)&p->epoch, FUTEX_WAIT_PRIVATE, e,
+	        NULL, NULL, 0);
+#else
+	(void)p;
+	(void)e;
+	sched_yield();
+#endif
+}
+
+/* Wakes up to n parked workers. Used internally. */
+static inline void
+aadeque_fj_wake(aadeque_fj_pool_t *p, int n) {
+	atomic_fetch_add(&p->epoch, 1);
+#ifdef __linux__
+	syscall(SYS_futex, (unsigned *)&p->epoch, FUTEX_WAKE_PRIVATE, n,
+	        NULL, NULL, 0);
+#else
+	(void)n;
+#endif
+}
+
+/* Runs a task and marks it as done. Used internally. */
+static inline void
+aadeque_fj_exec(struct aadeque_fj_task *t, struct aadeque_fj_worker *w) {
+	t->fn(t, w);
+	atomic_store_explicit(&t->done, 1, memory_order_release);
+}
+
+/*
+ * Tries to steal a task from a random worker other than w. Returns the task
+ * or NULL if none was found. Used internally.
+ */
+static inline struct aadeque_fj_task *
+aadeque_fj_steal(struct aadeque_fj_worker *w) {
+	aadeque_fj_pool_t *p = w->pool;
+	unsigned i, victim;
+	void *t;
+	if (p->nworkers < 2)
+		return NULL;
+	/* xorshift32 */
+	w->rng ^= w->rng << 13;
+	w->rng ^= w->rng >> 17;
+	w->rng ^= w->rng << 5;
+	/* Start at a random victim and try each of the others once. */
+	victim = w->rng % (p->nworkers - 1);
+	for (i = 0; i < p->nworkers - 1; i++, victim++) {
+		struct aadeque_fj_worker *v =
+			&p->workers[(w->id + 1 + victim % (p->nworkers - 1)) % p->nworkers];
+		int r;
+		while ((r = aadeque_ws_steal(v->deque, &t)) == AADEQUE_WS_ABORT)
+			;
+		if (r == AADEQUE_WS_OK)
+			return (struct aadeque_fj_task *)t;
+	}
+	return NULL;
+}
+
+/* Returns 1 if any worker has tasks in its deque. Used internally. */
+static inline int
+aadeque_fj_has_work(aadeque_fj_pool_t *p) {
+	unsigned i;
+	for (i = 0; i < p->nworkers; i++)
+		if (aadeque_ws_len(p->workers[i].deque) > 0)
+			return 1;
+	return 0;
+}
+
+/* The loop of the worker threads. Used internally. */
+static inline void *
+aadeque_fj_loop(void *arg) {
+	struct aadeque_fj_worker *w = (struct aadeque_fj_worker *)arg;
+	aadeque_fj_pool_t *p = w->pool;
+	int spins = 0;
+	while (!atomic_load_explicit(&p->stop, memory_order_acquire)) {
+		struct aadeque_fj_task *t = aadeque_fj_steal(w);
+		unsigned e;
+		if (t) {
+			aadeque_fj_exec(t, w);
+			spins = 0;
+			continue;
+		}
+		if (++spins < AADEQUE_FJ_SPINS) {
+			sched_yield();
+			continue;
+		}
+		/*
+		 * Park. The epoch is read before announcing ourselves as a sleeper
+		 * and the deques are checked after it, so a fork that pushes after
+		 * the check sees the sleeper and bumps the epoch. The fence pairs
+		 * with the one in aadeque_fj_fork(), since the deques are read
+		 * with relaxed loads.
+		 */
+		e = atomic_load(&p->epoch);
+		atomic_fetch_add(&p->sleepers, 1);
+		atomic_thread_fence(memory_order_seq_cst);
+		if (!aadeque_fj_has_work(p) && !atomic_load(&p->stop))
+			aadeque_fj_park(p, e);
+		atomic_fetch_sub(&p->sleepers, 1);
+		spins = 0;
+	}
+	return NULL;
+}
+
+/*
+ * Creates a pool of nworkers workers, including the thread that will call
+ * aadeque_fj_run(), so nworkers - 1 threads are started.
+ */
+static inline aadeque_fj_pool_t *
+aadeque_fj_create(unsigned nworkers) {
+	aadeque_fj_pool_t *p =
+		(aadeque_fj_pool_t *)AADEQUE_ALLOC(sizeof(aadeque_fj_pool_t));
+	unsigned i;
+	if (!p) AADEQUE_OOM();
+	p->nworkers = nworkers;
+	p->workers = (struct aadeque_fj_worker *)
+		AADEQUE_ALLOC(sizeof(struct aadeque_fj_worker) * nworkers);
+	if (!p->workers) AADEQUE_OOM();
+	atomic_init(&p->epoch, 0);
+	atomic_init(&p->sleepers, 0);
+	atomic_init(&p->stop, 0);
+	for (i = 0; i < nworkers; i++) {
+		p->workers[i].deque = aadeque_ws_create(64);
+		p->workers[i].pool = p;
+		p->workers[i].id = i;
+		p->workers[i].rng = 2463534242u + i;
+	}
+	for (i = 1; i < nworkers; i++)
+		if (pthread_create(&p->workers[i].thread, NULL, aadeque_fj_loop,
+		                   &p->workers[i]) != 0)
+			AADEQUE_OOM();
+	return p;
+}
+
+/*
+ * Stops the workers and frees the memory. No task may be running.
+ */
+static inline void
+aadeque_fj_destroy(aadeque_fj_pool_t *p) {
+	unsigned i;
+	atomic_store(&p->stop, 1);
+	aadeque_fj_wake(p, INT_MAX);
+	for (i = 1; i < p->nworkers; i++)
+		pthread_join(p->workers[i].thread, NULL);
+	for (i = 0; i < p->nworkers; i++)
+		aadeque_ws_destroy(p->workers[i].deque);
+	AADEQUE_FREE(p->workers, sizeof(struct aadeque_fj_worker) * p->nworkers);
+	AADEQUE_FREE(p, sizeof(aadeque_fj_pool_t));
+}
+
+/*
+ * Makes task t with the function fn available for running in parallel. It
+ * must be joined by the same task before that task returns.
+ */
+static inline void
+aadeque_fj_fork(struct aadeque_fj_worker *w, struct aadeque_fj_task *t,
+                void (*fn)(struct aadeque_fj_task *,
+                           struct aadeque_fj_worker *)) {
+	aadeque_fj_pool_t *p = w->pool;
+	t->fn = fn;
+	atomic_init(&t->done, 0);
+	aadeque_ws_push(w->deque, t);
+	/* Pairs with the parking in aadeque_fj_loop(). */
+	atomic_thread_fence(memory_order_seq_cst);
+	if (atomic_load_explicit(&p->sleepers, memory_order_relaxed) > 0)
+		aadeque_fj_wake(p, 1);
+}
+
+/*
+ * Waits until the forked task t is done. Meanwhile, runs other tasks.
+ */
+static inline void
+aadeque_fj_join(struct aadeque_fj_worker *w, struct aadeque_fj_task *t) {
+	while (!atomic_load_explicit(&t->done, memory_order_acquire)) {
+		void *other;
+		if (aadeque_ws_pop(w->deque, &other)) {
+			aadeque_fj_exec((struct aadeque_fj_task *)other, w);
+		}
+		else {
+			struct aadeque_fj_task *s = aadeque_fj_steal(w);
+			if (s)
+				aadeque_fj_exec(s, w);
+		}
+	}
+}
+
+/*
+ * Runs task t with the function fn on the pool, using the calling thread as
+ * worker 0, and returns when it is done. Only one thread may call this at a
+ * time.
+ */
+static inline void
+aadeque_fj_run(aadeque_fj_pool_t *p, struct aadeque_fj_task *t,
+               void (*fn)(struct aadeque_fj_task *,
+                          struct aadeque_fj_worker *)) {
+	t->fn = fn;
+	atomic_init(&t->done, 0);
+	aadeque_fj_exec(t, &p->workers[0]);
+}
+
+#endif
@@ -0,0 +1,136 @@
+/*
+ * aadeque_frames.h - Length-prefixed frames over a byte deque
+ *
+ * Each frame is a length prefix followed by that many bytes of payload. The
+ * length prefix is either a big-endian integer of 1, 2, 4 or 8 bytes or a
+ * LEB128 varint, selected by the lenbytes argument of the functions below (1,
+ * 2, 4, 8 or AADEQUE_FRAME_VARINT).
+ *
+ * Complete frames are found and accessed without copying, as one or two
+ * contiguous parts of the underlying buffer. A batch of frames is then
+ * consumed using a single call to aadeque_delete_first_n().
+ *
+ * This header is generic, like aadeque.h. Include it directly after including
+ * aadeque.h for an array deque with AADEQUE_VALUE_T defined to a byte type
+ * such as unsigned char. The functions get the same prefix:
+ *
+ *   #define AADEQUE_PREFIX bytes
+ *   #define AADEQUE_VALUE_T unsigned char
+ *   #include "aadeque.h"
+ *   #include "aadeque_frames.h"
+ *
+ * The author disclaims copyright to this source code.
+ */
+
+/* The lenbytes argument for a varint length prefix */
+#ifndef AADEQUE_FRAME_VARINT
+	#define AADEQUE_FRAME_VARINT 0
+#endif
+
+/* A varint of a 64 bit integer takes up to 10 bytes */
+#ifndef AADEQUE_FRAME_VARINT_MAX
+	#define AADEQUE_FRAME_VARINT_MAX 10
+#endif
+
+/*
+ * A frame in the deque. The payload is stored in one or two contiguous parts.
+ * If it doesn't wrap around the end of the underlying buffer, n[1] is 0.
+ */
+struct AADEQUE_NAME(_frame) {
+	AADEQUE_SIZE_T len;       /* length of the payload */
+	AADEQUE_VALUE_T *p[2];    /* the payload */
+	AADEQUE_SIZE_T n[2];      /* the lengths of the two parts of the payload */
+};
+
+/*
+ * Parses the frame starting at byte index *pos. Returns 1 if the whole frame
+ * is in the deque, 0 if more bytes are needed and -1 if the length prefix is
+ * malformed or the length doesn't fit in AADEQUE_SIZE_T.
+ *
+ * If the frame is complete, the payload is stored in *frame and *pos is
+ * advanced to the next frame. The pointers are valid until the deque is
+ * modified. If only the length prefix is complete, frame->len is set anyway,
+ * so that the caller can reject frames which are too large.
+ */
+static inline int
+AADEQUE_NAME(_frame_next)(AADEQUE_T *a, AADEQUE_SIZE_T *pos, int lenbytes,
+                          struct AADEQUE_NAME(_frame) *frame) {
+	AADEQUE_SIZE_T i = *pos, avail = a->len - *pos;
+	unsigned long long len = 0;
+	int k;
+	frame->len = 0;
+	if (lenbytes == AADEQUE_FRAME_VARINT) {
+		for (k = 0; ; k++) {
+			unsigned char byte;
+			if (k == AADEQUE_FRAME_VARINT_MAX)
+				return -1;
+			if ((AADEQUE_SIZE_T)k == avail)
+				return 0;
+			byte = (unsigned char)AADEQUE_NAME(_get)(a, i + k);
+			/* The 10th byte has room for only the 64th bit. */
+			if (k == AADEQUE_FRAME_VARINT_MAX - 1 && (byte & 0x7e))
+				return -1;
+			len |= (unsigned long long)(byte & 0x7f) << (7 * k);
+			if (!(byte & 0x80))
+				break;
+		}
+		k++;
+	}
+	else {
+		if ((AADEQUE_SIZE_T)lenbytes > avail)
+			return 0;
+		for (k = 0; k < lenbytes; k++)
+			len = (len << 8) | (unsigned char)AADEQUE_NAME(_get)(a, i + k);
+	}
+	if (len != (AADEQUE_SIZE_T)len)
+		return -1;
+	frame->len = (AADEQUE_SIZE_T)len;
+	if (len > avail - k)
+		return 0;
+	i += k;
+	frame->p[0] = AADEQUE_NAME(_span)(a, i, frame->len, &frame->n[0]);
+	frame->p[1] = AADEQUE_NAME(_span)(a, i + frame->n[0],
+	                                  frame->len - frame->n[0], &frame->n[1]);
+	*pos = i + frame->len;
+	return 1;
+}
+
+/*
+ * Inserts a frame with a payload of n bytes, copied from data, after the last
+ * byte. If n doesn't fit in lenbytes bytes, the behaviour is undefined.
+ * May change aptr if it needs to be reallocated.
+ */
+static inline void
+AADEQUE_NAME(_frame_push)(AADEQUE_T **aptr, int lenbytes, const void *data,
+                          AADEQUE_SIZE_T n) {
+	const unsigned char *src = (const unsigned char *)data;
+	unsigned char prefix[AADEQUE_FRAME_VARINT_MAX];
+	unsigned long long len = n;
+	AADEQUE_SIZE_T i, k;
+	int hdrlen = 0;
+	if (lenbytes == AADEQUE_FRAME_VARINT) {
+		while (len >= 0x80) {
+			prefix[hdrlen++] = (unsigned char)(len | 0x80);
+			len >>= 7;
+		}
+		prefix[hdrlen++] = (unsigned char)len;
+	}
+	else {
+		for (hdrlen = lenbytes; hdrlen > 0; hdrlen--) {
+			prefix[hdrlen - 1] = (unsigned char)len;
+			len >>= 8;
+		}
+		hdrlen = lenbytes;
+	}
+	i = (*aptr)->len;
+	*aptr = AADEQUE_NAME(_make_space_after)(*aptr, hdrlen + n);
+	for (k = 0; k < (AADEQUE_SIZE_T)hdrlen; k++)
+		AADEQUE_NAME(_set)(*aptr, i++, prefix[k]);
+	while (n > 0) {
+		AADEQUE_VALUE_T *dst = AADEQUE_NAME(_span)(*aptr, i, n, &k);
+		memcpy(dst, src, k);
+		src += k;
+		i += k;
+		n -= k;
+	}
+}
@@ -0,0 +1,144 @@
+/*
+ * aadeque_handoff.h - Double-buffered batch handoff between two threads
+ *
+ * A producer pushes values into an array deque of its own while the consumer
+ * processes the previous batch in another. The pushes are the ordinary ones,
+ * with no synchronisation at all. When the producer has a batch ready, it
+ * publishes it, and the consumer takes it with aadeque_handoff_swap(), giving
+ * back its previous batch emptied (keeping the capacity) for the producer to
+ * reuse. The only synchronisation is one atomic pointer exchange and one
+ * atomic store per batch on each side, and neither side ever waits.
+ *
+ * Three deques take turns: the producer's, the published batch and the
+ * consumer's batch, with the emptied one returned in a slot of its own until
+ * the producer picks it up on its next publish. A publish only succeeds when
+ * the consumer has taken the previous batch. Otherwise, the values stay in the
+ * producer's deque and are handed over with the next publish, so a slow
+ * consumer gets larger batches instead of blocking the producer. The deques
+ * keep their capacity from round to round, so there is no allocation in
+ * steady state.
+ *
+ * This header is generic, like aadeque.h. Include it directly after including
+ * aadeque.h and the functions get the same prefix. Requires C11 atomics.
+ *
+ * The author disclaims copyright to this source code.
+ */
+
+#ifndef AADEQUE_HANDOFF_COMMON
+#define AADEQUE_HANDOFF_COMMON
+
+#include <stdatomic.h>
+
+/* Size of a cache line, tweakable. The two sides are padded to this. */
+#ifndef AADEQUE_CACHE_LINE
+	#define AADEQUE_CACHE_LINE 64
+#endif
+
+#endif
+
+/* The handoff */
+struct AADEQUE_NAME(_handoff) {
+	AADEQUE_T *front;                  /* the producer's deque */
+	char pad1[AADEQUE_CACHE_LINE];
+	_Atomic(AADEQUE_T *) full;         /* the published batch, or NULL */
+	_Atomic(AADEQUE_T *) empty;        /* returned by the consumer, or NULL */
+	char pad2[AADEQUE_CACHE_LINE];
+	AADEQUE_T *back;                   /* the consumer's batch */
+};
+
+/*
+ * Creates a handoff with three empty deques.
+ */
+static inline struct AADEQUE_NAME(_handoff) *
+AADEQUE_NAME(_handoff_create)(void) {
+	struct AADEQUE_NAME(_handoff) *h = (struct AADEQUE_NAME(_handoff) *)
+		AADEQUE_ALLOC(sizeof(struct AADEQUE_NAME(_handoff)));
+	if (!h) AADEQUE_OOM();
+	h->front = AADEQUE_NAME(_create_empty)();
+	atomic_init(&h->full, NULL);
+	atomic_init(&h->empty, AADEQUE_NAME(_create_empty)());
+	h->back = AADEQUE_NAME(_create_empty)();
+	return h;
+}
+
+/*
+ * Frees the memory, including any values not taken.
+ */
+static inline void
+AADEQUE_NAME(_handoff_destroy)(struct AADEQUE_NAME(_handoff) *h) {
+	AADEQUE_T *full = atomic_load(&h->full), *empty = atomic_load(&h->empty);
+	AADEQUE_NAME(_destroy)(h->front);
+	if (full) AADEQUE_NAME(_destroy)(full);
+	if (empty) AADEQUE_NAME(_destroy)(empty);
+	AADEQUE_NAME(_destroy)(h->back);
+	AADEQUE_FREE(h, sizeof(struct AADEQUE_NAME(_handoff)));
+}
+
+/*
+ * Inserts a value at the end of the producer's deque. Only the producer may
+ * call this.
+ */
+static inline void
+AADEQUE_NAME(_handoff_push)(struct AADEQUE_NAME(_handoff) *h,
+                            AADEQUE_VALUE_T value) {
+	AADEQUE_NAME(_push)(&h->front, value);
+}
+
+/*
+ * Inserts n values from an array at the end of the producer's deque. Only the
+ * producer may call this.
+ */
+static inline void
+AADEQUE_NAME(_handoff_push_n)(struct AADEQUE_NAME(_handoff) *h,
+                              const AADEQUE_VALUE_T *values,
+                              AADEQUE_SIZE_T n) {
+	AADEQUE_SIZE_T i = h->front->len, k;
+	h->front = AADEQUE_NAME(_make_space_after)(h->front, n);
+	while (n > 0) {
+		AADEQUE_VALUE_T *p = AADEQUE_NAME(_span)(h->front, i, n, &k);
+		memcpy(p, values, sizeof(AADEQUE_VALUE_T) * k);
+		values += k;
+		i += k;
+		n -= k;
+	}
+}
+
+/*
+ * Hands over the values pushed since the last successful publish to the
+ * consumer, as one batch. Returns 1 if there are no values left to hand over,
+ * or 0 if the consumer hasn't taken the previous batch yet, in which case the
+ * values stay and are handed over by a later publish. Never waits. Only the
+ * producer may call this.
+ */
+static inline int
+AADEQUE_NAME(_handoff_publish)(struct AADEQUE_NAME(_handoff) *h) {
+	AADEQUE_T *empty;
+	if (h->front->len == 0)
+		return 1;
+	/* The consumer returns a deque after taking the previous batch. */
+	empty = atomic_exchange_explicit(&h->empty, NULL, memory_order_acquire);
+	if (!empty)
+		return 0;
+	atomic_store_explicit(&h->full, h->front, memory_order_release);
+	h->front = empty;
+	return 1;
+}
+
+/*
+ * Takes the published batch, with the values in the order they were pushed,
+ * or returns NULL if nothing has been published since the last swap. The
+ * consumer's previous batch is emptied, keeping its capacity, and given back
+ * to the producer. The new batch belongs to the consumer until the next
+ * successful swap. Never waits. Only the consumer may call this.
+ */
+static inline AADEQUE_T *
+AADEQUE_NAME(_handoff_swap)(struct AADEQUE_NAME(_handoff) *h) {
+	AADEQUE_T *batch = atomic_exchange_explicit(&h->full, NULL,
+	                                            memory_order_acquire);
+	if (!batch)
+		return NULL;
+	AADEQUE_NAME(_delete_all)(h->back);
+	atomic_store_explicit(&h->empty, h->back, memory_order_release);
+	h->back = batch;
+	return batch;
+}
@@ -0,0 +1,280 @@
+/*
+ * aadeque_hash.h - Hashing and checksumming the contents of an array deque
+ *
+ * The contents are processed as the one or two contiguous parts of the
+ * underlying buffer, without copying. The result is the same as hashing the
+ * elements as one contiguous array. Note that the bytes of the elements
+ * themselves are hashed, i.e. the pointers for an array deque of pointers.
+ *
+ * The hash function is XXH64. The checksum is CRC-32C (Castagnoli), using the
+ * crc32 instructions of SSE 4.2 or ARMv8 if they are enabled at compile time
+ * and a lookup table otherwise.
+ *
+ * This header is generic, like aadeque.h. Include it directly after including
+ * aadeque.h and the functions get the same prefix.
+ *
+ * The author disclaims copyright to this source code.
+ */
+
+#ifndef AADEQUE_HASH_COMMON
+#define AADEQUE_HASH_COMMON
+
+#include <stdint.h>
+#if defined(__SSE4_2__)
+	#include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32)
+	#include <arm_acle.h>
+#endif
+
+#define AADEQUE_XXH64_P1 0x9E3779B185EBCA87ULL
+#define AADEQUE_XXH64_P2 0xC2B2AE3D27D4EB4FULL
+#define AADEQUE_XXH64_P3 0x165667B19E3779F9ULL
+#define AADEQUE_XXH64_P4 0x85EBCA77C2B2AE63ULL
+#define AADEQUE_XXH64_P5 0x27D4EB2F165667C5ULL
+
+/* The state of an XXH64 computation, for hashing data in several parts. */
+struct aadeque_xxh64 {
+	uint64_t v[4];              /* the four accumulators */
+	uint64_t total;             /* number of bytes hashed */
+	uint64_t seed;
+	unsigned char buf[32];      /* a partial stripe */
+	unsigned buflen;
+};
+
+static inline uint64_t
+aadeque_xxh64_rotl(uint64_t x, int r) {
+	return (x << r) | (x >> (64 - r));
+}
+
+/* Reads a little-endian 64 bit integer. */
+static inline uint64_t
+aadeque_xxh64_read64(const unsigned char *p) {
+	return (uint64_t)p[0] | (uint64_t)p[1] << 8 | (uint64_t)p[2] << 16 |
+	       (uint64_t)p[3] << 24 | (uint64_t)p[4] << 32 | (uint64_t)p[5] << 40 |
+	       (uint64_t)p[6] << 48 | (uint64_t)p[7] << 56;
+}
+
+/* Reads a little-endian 32 bit integer. */
+static inline uint64_t
+aadeque_xxh64_read32(const unsigned char *p) {
+	return (uint64_t)p[0] | (uint64_t)p[1] << 8 | (uint64_t)p[2] << 16 |
+	       (uint64_t)p[3] << 24;
+}
+
+static inline uint64_t
+aadeque_xxh64_round(uint64_t acc, uint64_t input) {
+	acc += input * AADEQUE_XXH64_P2;
+	acc = aadeque_xxh64_rotl(acc, 31);
+	return acc * AADEQUE_XXH64_P1;
+}
+
+static inline uint64_t
+aadeque_xxh64_merge(uint64_t h, uint64_t v) {
+	h ^= aadeque_xxh64_round(0, v);
+	return h * AADEQUE_XXH64_P1 + AADEQUE_XXH64_P4;
+}
+
+/* Starts an XXH64 computation. */
+static inline void
+aadeque_xxh64_init(struct aadeque_xxh64 *s, uint64_t seed) {
+	s->v[0] = seed + AADEQUE_XXH64_P1 + AADEQUE_XXH64_P2;
+	s->v[1] = seed + AADEQUE_XXH64_P2;
+	s->v[2] = seed;
+	s->v[3] = seed - AADEQUE_XXH64_P1;
+	s->total = 0;
+	s->seed = seed;
+	s->buflen = 0;
+}
+
+/* Hashes a stripe of 32 bytes. Used internally. */
+static inline void
+aadeque_xxh64_stripe(struct aadeque_xxh64 *s, const unsigned char *p) {
+	s->v[0] = aadeque_xxh64_round(s->v[0], aadeque_xxh64_read64(p));
+	s->v[1] = aadeque_xxh64_round(s->v[1], aadeque_xxh64_read64(p + 8));
+	s->v[2] = aadeque_xxh64_round(s->v[2], aadeque_xxh64_read64(p + 16));
+	s->v[3] = aadeque_xxh64_round(s->v[3], aadeque_xxh64_read64(p + 24));
+}
+
+/* Adds n bytes to an XXH64 computation. */
+static inline void
+aadeque_xxh64_update(struct aadeque_xxh64 *s, const void *data, size_t n) {
+	const unsigned char *p = (const unsigned char *)data;
+	s->total += n;
+	if (s->buflen > 0) {
+		/* Complete the partial stripe from the previous part. */
+		size_t k = 32 - s->buflen < n ? 32 - s->buflen : n;
+		memcpy(s->buf + s->buflen, p, k);
+		s->buflen += (unsigned)k;
+		p += k;
+		n -= k;
+		if (s->buflen < 32)
+			return;
+		aadeque_xxh64_stripe(s, s->buf);
+		s->buflen = 0;
+	}
+	for (; n >= 32; p += 32, n -= 32)
+		aadeque_xxh64_stripe(s, p);
+	memcpy(s->buf, p, n);
+	s->buflen = (unsigned)n;
+}
+
+/* Returns the hash of all the bytes added so far. */
+static inline uint64_t
+aadeque_xxh64_digest(const struct aadeque_xxh64 *s) {
+	const unsigned char *p = s->buf;
+	unsigned n = s->buflen;
+	uint64_t h;
+	if (s->total >= 32) {
+		h = aadeque_xxh64_rotl(s->v[0], 1) + aadeque_xxh64_rotl(s->v[1], 7) +
+		    aadeque_xxh64_rotl(s->v[2], 12) + aadeque_xxh64_rotl(s->v[3], 18);
+		h = aadeque_xxh64_merge(h, s->v[0]);
+		h = aadeque_xxh64_merge(h, s->v[1]);
+		h = aadeque_xxh64_merge(h, s->v[2]);
+		h = aadeque_xxh64_merge(h, s->v[3]);
+	}
+	else {
+		h = s->seed + AADEQUE_XXH64_P5;
+	}
+	h += s->total;
+	for (; n >= 8; p += 8, n -= 8) {
+		h ^= aadeque_xxh64_round(0, aadeque_xxh64_read64(p));
+		h = aadeque_xxh64_rotl(h, 27) * AADEQUE_XXH64_P1 + AADEQUE_XXH64_P4;
+	}
+	if (n >= 4) {
+		h ^= aadeque_xxh64_read32(p) * AADEQUE_XXH64_P1;
+		h = aadeque_xxh64_rotl(h, 23) * AADEQUE_XXH64_P2 + AADEQUE_XXH64_P3;
+		p += 4;
+		n -= 4;
+	}
+	for (; n > 0; p++, n--) {
+		h ^= *p * AADEQUE_XXH64_P5;
+		h = aadeque_xxh64_rotl(h, 11) * AADEQUE_XXH64_P1;
+	}
+	h ^= h >> 33;
+	h *= AADEQUE_XXH64_P2;
+	h ^= h >> 29;
+	h *= AADEQUE_XXH64_P3;
+	h ^= h >> 32;
+	return h;
+}
+
+/* Lookup table for CRC-32C, reflected polynomial 0x82F63B78. */
+static const uint32_t aadeque_crc32c_table[256] = {
+	0x00000000, 0xf26b8303, 0xe13b70f7, 0x1350f3f4, 0xc79a971f, 0x35f1141c,
+	0x26a1e7e8, 0xd4ca64eb, 0x8ad958cf, 0x78b2dbcc, 0x6be22838, 0x9989ab3b,
+	0x4d43cfd0, 0xbf284cd3, 0xac78bf27, 0x5e133c24, 0x105ec76f, 0xe235446c,
+	0xf165b798, 0x030e349b, 0xd7c45070, 0x25afd373, 0x36ff2087, 0xc494a384,
+	0x9a879fa0, 0x68ec1ca3, 0x7bbcef57, 0x89d76c54, 0x5d1d08bf, 0xaf768bbc,
+	0xbc267848, 0x4e4dfb4b, 0x20bd8ede, 0xd2d60ddd, 0xc186fe29, 0x33ed7d2a,
+	0xe72719c1, 0x154c9ac2, 0x061c6936, 0xf477ea35, 0xaa64d611, 0x580f5512,
+	0x4b5fa6e6, 0xb93425e5, 0x6dfe410e, 0x9f95c20d, 0x8cc531f9, 0x7eaeb2fa,
+	0x30e349b1, 0xc288cab2, 0xd1d83946, 0x23b3ba45, 0xf779deae, 0x05125dad,
+	0x1642ae59, 0xe4292d5a, 0xba3a117e, 0x4851927d, 0x5b016189, 0xa96ae28a,
+	0x7da08661, 0x8fcb0562, 0x9c9bf696, 0x6ef07595, 0x417b1dbc, 0xb3109ebf,
+	0xa0406d4b, 0x522bee48, 0x86e18aa3, 0x748a09a0, 0x67dafa54, 0x95b17957,
+	0xcba24573, 0x39c9c670, 0x2a993584, 0xd8f2b687, 0x0c38d26c, 0xfe53516f,
+	0xed03a29b, 0x1f682198, 0x5125dad3, 0xa34e59d0, 0xb01eaa24, 0x42752927,
+	0x96bf4dcc, 0x64d4cecf, 0x77843d3b, 0x85efbe38, 0xdbfc821c, 0x2997011f,
+	0x3ac7f2eb, 0xc8ac71e8, 0x1c661503, 0xee0d9600, 0xfd5d65f4, 0x0f36e6f7,
+	0x61c69362, 0x93ad1061, 0x80fde395, 0x72966096, 0xa65c047d, 0x5437877e,
+	0x4767748a, 0xb50cf789, 0xeb1fcbad, 0x197448ae, 0x0a24bb5a, 0xf84f3859,
+	0x2c855cb2, 0xdeeedfb1, 0xcdbe2c45, 0x3fd5af46, 0x7198540d, 0x83f3d70e,
+	0x90a324fa, 0x62c8a7f9, 0xb602c312, 0x44694011, 0x5739b3e5, 0xa55230e6,
+	0xfb410cc2, 0x092a8fc1, 0x1a7a7c35, 0xe811ff36, 0x3cdb9bdd, 0xceb018de,
+	0xdde0eb2a, 0x2f8b6829, 0x82f63b78, 0x709db87b, 0x63cd4b8f, 0x91a6c88c,
+	0x456cac67, 0xb7072f64, 0xa457dc90, 0x563c5f93, 0x082f63b7, 0xfa44e0b4,
+	0xe9141340, 0x1b7f9043, 0xcfb5f4a8, 0x3dde77ab, 0x2e8e845f, 0xdce5075c,
+	0x92a8fc17, 0x60c37f14, 0x73938ce0, 0x81f80fe3, 0x55326b08, 0xa759e80b,
+	0xb4091bff, 0x466298fc, 0x1871a4d8, 0xea1a27db, 0xf94ad42f, 0x0b21572c,
+	0xdfeb33c7, 0x2d80b0c4, 0x3ed04330, 0xccbbc033, 0xa24bb5a6, 0x502036a5,
+	0x4370c551, 0xb11b4652, 0x65d122b9, 0x97baa1ba, 0x84ea524e, 0x7681d14d,
+	0x2892ed69, 0xdaf96e6a, 0xc9a99d9e, 0x3bc21e9d, 0xef087a76, 0x1d63f975,
+	0x0e330a81, 0xfc588982, 0xb21572c9, 0x407ef1ca, 0x532e023e, 0xa145813d,
+	0x758fe5d6, 0x87e466d5, 0x94b49521, 0x66df1622, 0x38cc2a06, 0xcaa7a905,
+	0xd9f75af1, 0x2b9cd9f2, 0xff56bd19, 0x0d3d3e1a, 0x1e6dcdee, 0xec064eed,
+	0xc38d26c4, 0x31e6a5c7, 0x22b65633, 0xd0ddd530, 0x0417b1db, 0xf67c32d8,
+	0xe52cc12c, 0x1747422f, 0x49547e0b, 0xbb3ffd08, 0xa86f0efc, 0x5a048dff,
+	0x8ecee914, 0x7ca56a17, 0x6ff599e3, 0x9d9e1ae0, 0xd3d3e1ab, 0x21b862a8,
+	0x32e8915c, 0xc083125f, 0x144976b4, 0xe622f5b7, 0xf5720643, 0x07198540,
+	0x590ab964, 0xab613a67, 0xb831c993, 0x4a5a4a90, 0x9e902e7b, 0x6cfbad78,
+	0x7fab5e8c, 0x8dc0dd8f, 0xe330a81a, 0x115b2b19, 0x020bd8ed, 0xf0605bee,
+	0x24aa3f05, 0xd6c1bc06, 0xc5914ff2, 0x37faccf1, 0x69e9f0d5, 0x9b8273d6,
+	0x88d28022, 0x7ab90321, 0xae7367ca, 0x5c18e4c9, 0x4f48173d, 0xbd23943e,
+	0xf36e6f75, 0x0105ec76, 0x12551f82, 0xe03e9c81, 0x34f4f86a, 0xc69f7b69,
+	0xd5cf889d, 0x27a40b9e, 0x79b737ba, 0x8bdcb4b9, 0x988c474d, 0x6ae7c44e,
+	0xbe2da0a5, 0x4c4623a6, 0x5f16d052, 0xad7d5351,
+};
+
+/*
+ * Updates a CRC-32C with n bytes. Start with crc = 0. The value is
+ * pre- and post-conditioned internally, so the result of one call can be
+ * passed to the next one to checksum data in several parts.
+ */
+static inline uint32_t
+aadeque_crc32c_update(uint32_t crc, const void *data, size_t n) {
+	const unsigned char *p = (const unsigned char *)data;
+	crc = ~crc;
+	#if defined(__SSE4_2__) && defined(__x86_64__)
+	{
+		uint64_t crc64 = crc;
+		for (; n >= 8; p += 8, n -= 8) {
+			uint64_t w;
+			memcpy(&w, p, 8);
+			crc64 = _mm_crc32_u64(crc64, w);
+		}
+		crc = (uint32_t)crc64;
+	}
+	for (; n > 0; p++, n--)
+		crc = _mm_crc32_u8(crc, *p);
+	#elif defined(__SSE4_2__)
+	for (; n > 0; p++, n--)
+		crc = _mm_crc32_u8(crc, *p);
+	#elif defined(__ARM_FEATURE_CRC32)
+	for (; n >= 8; p += 8, n -= 8) {
+		uint64_t w;
+		memcpy(&w, p, 8);
+		crc = __crc32cd(crc, w);
+	}
+	for (; n > 0; p++, n--)
+		crc = __crc32cb(crc, *p);
+	#else
+	for (; n > 0; p++, n--)
+		crc = aadeque_crc32c_table[(crc ^ *p) & 0xff] ^ (crc >> 8);
+	#endif
+	return ~crc;
+}
+
+#endif
+
+/*
+ * Returns the XXH64 hash of the bytes of all elements, with the given seed.
+ */
+static inline uint64_t
+AADEQUE_NAME(_hash)(AADEQUE_T *a, uint64_t seed) {
+	struct aadeque_xxh64 s;
+	AADEQUE_SIZE_T i = 0, n = a->len, k;
+	aadeque_xxh64_init(&s, seed);
+	while (n > 0) {
+		AADEQUE_VALUE_T *p = AADEQUE_NAME(_span)(a, i, n, &k);
+		aadeque_xxh64_update(&s, p, sizeof(AADEQUE_VALUE_T) * k);
+		i += k;
+		n -= k;
+	}
+	return aadeque_xxh64_digest(&s);
+}
+
+/*
+ * Returns the CRC-32C checksum of the bytes of all elements.
+ */
+static inline uint32_t
+AADEQUE_NAME(_crc32c)(AADEQUE_T *a) {
+	uint32_t crc = 0;
+	AADEQUE_SIZE_T i = 0, n = a->len, k;
+	while (n > 0) {
+		AADEQUE_VALUE_T *p = AADEQUE_NAME(_span)(a, i, n, &k);
+		crc = aadeque_crc32c_update(crc, p, sizeof(AADEQUE_VALUE_T) * k);
+		i += k;
+		n -= k;
+	}
+	return crc;
+}
@@ -0,0 +1,89 @@
+/*
+ * aadeque_multi.h - Batch push and shift across many array deques
+ *
+ * For programs that keep thousands of array deques, such as one queue per
+ * network flow, and insert into or take from many of them at a time. Each
+ * operation on a different deque is likely a cache miss on its header, and
+ * then on its buffer. The batch functions hide this latency by software
+ * pipelining: while operating on the deque of entry i, they prefetch the
+ * header of the deque of entry i + 2 * AADEQUE_MULTI_DISTANCE and the buffer
+ * slot of entry i + AADEQUE_MULTI_DISTANCE, whose header was prefetched
+ * before.
+ *
+ * A push checks for free space with a single comparison and writes the value
+ * directly, taking the ordinary, reallocating path only when the deque is
+ * full. The same deque may occur more than once in a batch.
+ *
+ * This header is generic, like aadeque.h. Include it directly after including
+ * aadeque.h and the functions get the same prefix.
+ *
+ * The author disclaims copyright to this source code.
+ */
+
+#include <stddef.h>
+
+/* Prefetch distance, in batch entries, tweakable */
+#ifndef AADEQUE_MULTI_DISTANCE
+	#define AADEQUE_MULTI_DISTANCE 8
+#endif
+
+/* An entry in a batch: a deque and a value */
+struct AADEQUE_NAME(_op) {
+	AADEQUE_T **aptr;       /* the variable holding the array deque */
+	AADEQUE_VALUE_T value;
+};
+
+/*
+ * Inserts each value at the end of its deque, in order. The deques may be
+ * reallocated, as by aadeque_push().
+ */
+static inline void
+AADEQUE_NAME(_push_many)(struct AADEQUE_NAME(_op) *ops, size_t n) {
+	size_t i;
+	for (i = 0; i < n; i++) {
+		AADEQUE_T *a;
+		if (i + 2 * AADEQUE_MULTI_DISTANCE < n)
+			AADEQUE_PREFETCH(*ops[i + 2 * AADEQUE_MULTI_DISTANCE].aptr, 1);
+		if (i + AADEQUE_MULTI_DISTANCE < n) {
+			a = *ops[i + AADEQUE_MULTI_DISTANCE].aptr;
+			if (a->len < a->cap)
+				AADEQUE_PREFETCH(&a->els[AADEQUE_NAME(_idx)(a, a->len)], 1);
+		}
+		a = *ops[i].aptr;
+		if (a->len < a->cap) {
+			a->els[AADEQUE_NAME(_idx)(a, a->len)] = ops[i].value;
+			a->len++;
+		}
+		else {
+			AADEQUE_NAME(_push)(ops[i].aptr, ops[i].value);
+		}
+	}
+}
+
+/*
+ * Removes the first value of each of the n deques that is not empty, in order,
+ * e.g. for a round-robin scheduler. Stores each deque and the value removed
+ * from it in ops, which must have room for n entries. Returns the number of
+ * entries stored. The deques may be reallocated, as by aadeque_shift().
+ */
+static inline size_t
+AADEQUE_NAME(_shift_many)(AADEQUE_T **aptrs[], size_t n,
+                          struct AADEQUE_NAME(_op) *ops) {
+	size_t i, k = 0;
+	for (i = 0; i < n; i++) {
+		AADEQUE_T *a;
+		if (i + 2 * AADEQUE_MULTI_DISTANCE < n)
+			AADEQUE_PREFETCH(*aptrs[i + 2 * AADEQUE_MULTI_DISTANCE], 1);
+		if (i + AADEQUE_MULTI_DISTANCE < n) {
+			a = *aptrs[i + AADEQUE_MULTI_DISTANCE];
+			if (a->len > 0)
+				AADEQUE_PREFETCH(&a->els[a->off], 0);
+		}
+		if ((*aptrs[i])->len == 0)
+			continue;
+		ops[k].aptr = aptrs[i];
+		ops[k].value = AADEQUE_NAME(_shift)(aptrs[i]);
+		k++;
+	}
+	return k;
+}
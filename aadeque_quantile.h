@@ -0,0 +1,264 @@
+/*
+ * aadeque_quantile.h - Median and quantiles over a sliding window
+ *
+ * The values in the window are kept in an array deque in arrival order, so
+ * that the oldest value is known when it is shifted out. The same values are
+ * also kept in a treap (a randomized balanced binary search tree) where each
+ * node stores the size of its subtree. This makes it possible to find the
+ * k-th smallest value in the window in O(log n), and to insert and remove
+ * values in O(log n), expected.
+ *
+ * The tree nodes are stored in a growable array and refer to each other by
+ * index, with index 0 as the empty tree. Removed nodes are kept in a free list
+ * for reuse, so there is no allocation per value in steady state.
+ *
+ * NaN is ordered after all other values, and equal to itself, so NaNs in the
+ * window count as the largest values.
+ *
+ * This header instantiates aadeque.h with the prefix aadeque_qwindow. The
+ * macros that configure an instantiation, such as AADEQUE_PREFIX and
+ * AADEQUE_ARITHMETIC, are saved before and restored after it, using
+ * aadeque_config_push.h and aadeque_config_pop.h, so your own definitions of
+ * them are unaffected.
+ *
+ * The author disclaims copyright to this source code.
+ */
+#ifndef AADEQUE_QUANTILE_H
+#define AADEQUE_QUANTILE_H
+
+#include <stdint.h>
+#include <math.h>
+
+#include "aadeque_config_push.h"
+#define AADEQUE_PREFIX aadeque_qwindow
+#define AADEQUE_VALUE_T double
+#include "aadeque.h"
+#include "aadeque_config_pop.h"
+
+/* A node in the treap */
+struct aadeque_quantile_node {
+	double value;
+	uint32_t prio;          /* random heap priority */
+	AADEQUE_SIZE_T size;    /* number of nodes in this subtree */
+	AADEQUE_SIZE_T left;    /* index of the left child, 0 if none */
+	AADEQUE_SIZE_T right;   /* index of the right child, 0 if none */
+};
+
+/* The quantile tracker */
+typedef struct aadeque_quantile {
+	struct aadeque_qwindow *window;       /* the values in arrival order */
+	struct aadeque_quantile_node *nodes;  /* node 0 is the empty tree */
+	AADEQUE_SIZE_T nodecap;               /* allocated number of nodes */
+	AADEQUE_SIZE_T used;                  /* nodes used, including free ones */
+	AADEQUE_SIZE_T freelist;              /* first free node, linked by left */
+	AADEQUE_SIZE_T root;
+	uint32_t rng;                         /* state for the priorities */
+} aadeque_quantile_t;
+
+/*
+ * Creates an empty quantile tracker.
+ */
+static inline aadeque_quantile_t *
+aadeque_quantile_create(void) {
+	aadeque_quantile_t *t =
+		(aadeque_quantile_t *)AADEQUE_ALLOC(sizeof(aadeque_quantile_t));
+	if (!t) AADEQUE_OOM();
+	t->window = aadeque_qwindow_create_empty();
+	t->nodecap = AADEQUE_MIN_CAPACITY + 1;
+	t->nodes = (struct aadeque_quantile_node *)
+		AADEQUE_ALLOC(sizeof(struct aadeque_quantile_node) * t->nodecap);
+	if (!t->nodes) AADEQUE_OOM();
+	memset(&t->nodes[0], 0, sizeof(struct aadeque_quantile_node));
+	t->used = 1;
+	t->freelist = 0;
+	t->root = 0;
+	t->rng = 2463534242u;
+	return t;
+}
+
+/*
+ * Frees the memory.
+ */
+static inline void
+aadeque_quantile_destroy(aadeque_quantile_t *t) {
+	aadeque_qwindow_destroy(t->window);
+	AADEQUE_FREE(t->nodes, sizeof(struct aadeque_quantile_node) * t->nodecap);
+	AADEQUE_FREE(t, sizeof(aadeque_quantile_t));
+}
+
+/*
+ * Returns the number of values in the window.
+ */
+static inline AADEQUE_SIZE_T
+aadeque_quantile_len(aadeque_quantile_t *t) {
+	return t->window->len;
+}
+
+/* Recomputes the size of node x from its children. Used internally. */
+static inline void
+aadeque_quantile_update(aadeque_quantile_t *t, AADEQUE_SIZE_T x) {
+	struct aadeque_quantile_node *n = t->nodes;
+	n[x].size = n[n[x].left].size + n[n[x].right].size + 1;
+}
+
+/* x < y, with NaN after all other values. Used internally. */
+static inline int
+aadeque_quantile_lt(double x, double y) {
+	return !isnan(x) && (isnan(y) || x < y);
+}
+
+/* x == y, with NaN equal to itself. Used internally. */
+static inline int
+aadeque_quantile_eq(double x, double y) {
+	return x == y || (isnan(x) && isnan(y));
+}
+
+/*
+ * Splits tree x into *l with the values less than v (or, if inclusive, less
+ * than or equal to v) and *r with the rest. Used internally.
+ */
+static inline void
+aadeque_quantile_split(aadeque_quantile_t *t, AADEQUE_SIZE_T x, double v,
+                       int inclusive, AADEQUE_SIZE_T *l, AADEQUE_SIZE_T *r) {
+	struct aadeque_quantile_node *n = t->nodes;
+	if (x == 0) {
+		*l = *r = 0;
+	}
+	else if (aadeque_quantile_lt(n[x].value, v) ||
+	         (inclusive && aadeque_quantile_eq(n[x].value, v))) {
+		aadeque_quantile_split(t, n[x].right, v, inclusive, &n[x].right, r);
+		aadeque_quantile_update(t, x);
+		*l = x;
+	}
+	else {
+		aadeque_quantile_split(t, n[x].left, v, inclusive, l, &n[x].left);
+		aadeque_quantile_update(t, x);
+		*r = x;
+	}
+}
+
+/*
+ * Merges the trees l and r, where all values in l are less than or equal to
+ * those in r. Returns the merged tree. Used internally.
+ */
+static inline AADEQUE_SIZE_T
+aadeque_quantile_merge(aadeque_quantile_t *t, AADEQUE_SIZE_T l,
+                       AADEQUE_SIZE_T r) {
+	struct aadeque_quantile_node *n = t->nodes;
+	if (l == 0)
+		return r;
+	if (r == 0)
+		return l;
+	if (n[l].prio > n[r].prio) {
+		n[l].right = aadeque_quantile_merge(t, n[l].right, r);
+		aadeque_quantile_update(t, l);
+		return l;
+	}
+	n[r].left = aadeque_quantile_merge(t, l, n[r].left);
+	aadeque_quantile_update(t, r);
+	return r;
+}
+
+/*
+ * Insert a value at the end of the window.
+ */
+static inline void
+aadeque_quantile_push(aadeque_quantile_t *t, double value) {
+	AADEQUE_SIZE_T x, l, r;
+	aadeque_qwindow_push(&t->window, value);
+	/* Take a node from the free list or from the end of the array. */
+	if (t->freelist != 0) {
+		x = t->freelist;
+		t->freelist = t->nodes[x].left;
+	}
+	else {
+		if (t->used == t->nodecap) {
+			AADEQUE_SIZE_T oldcap = t->nodecap;
+			t->nodecap <<= 1;
+			t->nodes = (struct aadeque_quantile_node *)AADEQUE_REALLOC(
+				t->nodes,
+				sizeof(struct aadeque_quantile_node) * t->nodecap,
+				sizeof(struct aadeque_quantile_node) * oldcap);
+			if (!t->nodes) AADEQUE_OOM();
+		}
+		x = t->used++;
+	}
+	/* xorshift32 */
+	t->rng ^= t->rng << 13;
+	t->rng ^= t->rng >> 17;
+	t->rng ^= t->rng << 5;
+	t->nodes[x].value = value;
+	t->nodes[x].prio = t->rng;
+	t->nodes[x].size = 1;
+	t->nodes[x].left = t->nodes[x].right = 0;
+	aadeque_quantile_split(t, t->root, value, 1, &l, &r);
+	t->root = aadeque_quantile_merge(t, aadeque_quantile_merge(t, l, x), r);
+}
+
+/*
+ * Remove the oldest value from the window and return it. The window must not
+ * be empty.
+ */
+static inline double
+aadeque_quantile_shift(aadeque_quantile_t *t) {
+	double value = aadeque_qwindow_shift(&t->window);
+	AADEQUE_SIZE_T l, m, r, x;
+	/* Split out the nodes equal to value and remove the root of those. */
+	aadeque_quantile_split(t, t->root, value, 0, &l, &r);
+	aadeque_quantile_split(t, r, value, 1, &m, &r);
+	x = m;
+	m = aadeque_quantile_merge(t, t->nodes[x].left, t->nodes[x].right);
+	t->nodes[x].left = t->freelist;
+	t->freelist = x;
+	t->root = aadeque_quantile_merge(t, aadeque_quantile_merge(t, l, m), r);
+	return value;
+}
+
+/*
+ * Returns the k-th smallest value in the window, for 0 <= k < length. The
+ * index bounds are not checked.
+ */
+static inline double
+aadeque_quantile_kth(aadeque_quantile_t *t, AADEQUE_SIZE_T k) {
+	struct aadeque_quantile_node *n = t->nodes;
+	AADEQUE_SIZE_T x = t->root;
+	for (;;) {
+		AADEQUE_SIZE_T lsize = n[n[x].left].size;
+		if (k < lsize) {
+			x = n[x].left;
+		}
+		else if (k == lsize) {
+			return n[x].value;
+		}
+		else {
+			k -= lsize + 1;
+			x = n[x].right;
+		}
+	}
+}
+
+/*
+ * Returns the q-quantile of the values in the window, for 0 <= q <= 1, using
+ * linear interpolation between the closest ranks. The window must not be
+ * empty.
+ */
+static inline double
+aadeque_quantile_get(aadeque_quantile_t *t, double q) {
+	double pos = q * (t->window->len - 1);
+	AADEQUE_SIZE_T k = (AADEQUE_SIZE_T)pos;
+	double lo = aadeque_quantile_kth(t, k);
+	if (k + 1 >= t->window->len || pos == (double)k)
+		return lo;
+	return lo + (pos - k) * (aadeque_quantile_kth(t, k + 1) - lo);
+}
+
+/*
+ * Returns the median of the values in the window, i.e. the middle value or
+ * the mean of the two middle values. The window must not be empty.
+ */
+static inline double
+aadeque_quantile_median(aadeque_quantile_t *t) {
+	return aadeque_quantile_get(t, 0.5);
+}
+
+#endif
@@ -0,0 +1,237 @@
+/*
+ * aadeque_rcu.h - Snapshots of an array deque for lock-free readers
+ *
+ * One writer updates an array deque with the ordinary functions and publishes
+ * a snapshot of it from time to time. Readers in other threads read the
+ * latest published snapshot without locks and without blocking the writer.
+ * A snapshot is an immutable copy of the array deque, made when published (a
+ * read-copy-update scheme), with a version number that is incremented on each
+ * publish.
+ *
+ * Publishing copies the whole deque, so it is O(n) in the length of the
+ * deque. It is meant to be called once per batch of updates, such as once per
+ * request or per timer tick, so that the copy is amortized over the batch. If
+ * the readers need to see each update as soon as it's made, publishing after
+ * every update costs O(n) per update; for a ring of the latest values,
+ * aadeque_seqlock.h does that in O(1).
+ *
+ * Replaced snapshots are reclaimed using epochs. Each reader has a slot where
+ * it stores the global epoch when it starts reading and clears it when done.
+ * On publish, the writer bumps the epoch and a replaced snapshot can be
+ * reused when all readers that may have seen it are done. Reclaimed snapshots
+ * are reused for the next publish, so in steady state publishing is a copy
+ * into an existing buffer, without allocation.
+ *
+ * This header is generic, like aadeque.h. Include it directly after including
+ * aadeque.h and the functions get the same prefix. Requires C11 atomics.
+ *
+ * The author disclaims copyright to this source code.
+ */
+
+#ifndef AADEQUE_RCU_COMMON
+#define AADEQUE_RCU_COMMON
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/* Maximum number of registered readers, tweakable */
+#ifndef AADEQUE_RCU_MAX_READERS
+	#define AADEQUE_RCU_MAX_READERS 64
+#endif
+
+/* Size of a cache line, tweakable. Each reader slot is padded to this. */
+#ifndef AADEQUE_CACHE_LINE
+	#define AADEQUE_CACHE_LINE 64
+#endif
+
+/* A reader slot. Used internally. */
+struct aadeque_rcu_slot {
+	atomic_uint_fast64_t epoch;     /* the epoch when reading began, or 0 */
+	atomic_int used;                /* registered */
+	char pad[AADEQUE_CACHE_LINE];
+};
+
+#endif
+
+/* A snapshot. Readers may only read it. */
+struct AADEQUE_NAME(_snapshot) {
+	AADEQUE_T *a;                   /* the copy of the deque */
+	uint64_t version;
+	uint64_t retired;               /* the epoch when it was replaced */
+	struct AADEQUE_NAME(_snapshot) *next; /* in the retired or free list */
+};
+
+/* The writer's deque with its published snapshots */
+struct AADEQUE_NAME(_rcu) {
+	AADEQUE_T *a;                   /* the writer's deque */
+	_Atomic(struct AADEQUE_NAME(_snapshot) *) current;
+	atomic_uint_fast64_t epoch;
+	uint64_t version;
+	struct AADEQUE_NAME(_snapshot) *retired; /* replaced, maybe in use */
+	struct AADEQUE_NAME(_snapshot) *free;    /* reclaimed, for reuse */
+	struct aadeque_rcu_slot slots[AADEQUE_RCU_MAX_READERS];
+};
+
+/*
+ * Creates an empty deque and publishes it as the first snapshot, version 0.
+ */
+static inline struct AADEQUE_NAME(_rcu) *
+AADEQUE_NAME(_rcu_create)(void) {
+	struct AADEQUE_NAME(_rcu) *r = (struct AADEQUE_NAME(_rcu) *)
+		AADEQUE_ALLOC(sizeof(struct AADEQUE_NAME(_rcu)));
+	struct AADEQUE_NAME(_snapshot) *s = (struct AADEQUE_NAME(_snapshot) *)
+		AADEQUE_ALLOC(sizeof(struct AADEQUE_NAME(_snapshot)));
+	int i;
+	if (!r || !s) AADEQUE_OOM();
+	r->a = AADEQUE_NAME(_create_empty)();
+	s->a = AADEQUE_NAME(_create_empty)();
+	s->version = 0;
+	s->next = NULL;
+	atomic_init(&r->current, s);
+	atomic_init(&r->epoch, 1);
+	r->version = 0;
+	r->retired = r->free = NULL;
+	for (i = 0; i < AADEQUE_RCU_MAX_READERS; i++) {
+		atomic_init(&r->slots[i].epoch, 0);
+		atomic_init(&r->slots[i].used, 0);
+	}
+	return r;
+}
+
+/* Frees a list of snapshots. Used internally. */
+static inline void
+AADEQUE_NAME(_rcu_free_list)(struct AADEQUE_NAME(_snapshot) *s) {
+	while (s) {
+		struct AADEQUE_NAME(_snapshot) *next = s->next;
+		AADEQUE_NAME(_destroy)(s->a);
+		AADEQUE_FREE(s, sizeof(struct AADEQUE_NAME(_snapshot)));
+		s = next;
+	}
+}
+
+/*
+ * Frees the memory. No reader may be reading at this point.
+ */
+static inline void
+AADEQUE_NAME(_rcu_destroy)(struct AADEQUE_NAME(_rcu) *r) {
+	AADEQUE_NAME(_rcu_free_list)(atomic_load(&r->current));
+	AADEQUE_NAME(_rcu_free_list)(r->retired);
+	AADEQUE_NAME(_rcu_free_list)(r->free);
+	AADEQUE_NAME(_destroy)(r->a);
+	AADEQUE_FREE(r, sizeof(struct AADEQUE_NAME(_rcu)));
+}
+
+/*
+ * Returns a pointer to the writer's deque, to be updated using the ordinary
+ * functions, e.g. aadeque_push(aadeque_rcu_writer(r), x). Only the writer may
+ * use it.
+ */
+static inline AADEQUE_T **
+AADEQUE_NAME(_rcu_writer)(struct AADEQUE_NAME(_rcu) *r) {
+	return &r->a;
+}
+
+/*
+ * Moves the retired snapshots that no reader can be using to the free list.
+ * Used internally.
+ */
+static inline void
+AADEQUE_NAME(_rcu_reclaim)(struct AADEQUE_NAME(_rcu) *r) {
+	struct AADEQUE_NAME(_snapshot) **sp = &r->retired;
+	uint64_t oldest = UINT64_MAX;
+	int i;
+	/* The oldest epoch in which a reader is still reading */
+	for (i = 0; i < AADEQUE_RCU_MAX_READERS; i++) {
+		uint64_t e = atomic_load(&r->slots[i].epoch);
+		if (e != 0 && e < oldest)
+			oldest = e;
+	}
+	/* A reader that started after the epoch when s was replaced can't see s */
+	while (*sp) {
+		struct AADEQUE_NAME(_snapshot) *s = *sp;
+		if (s->retired < oldest) {
+			*sp = s->next;
+			s->next = r->free;
+			r->free = s;
+		}
+		else {
+			sp = &s->next;
+		}
+	}
+}
+
+/*
+ * Publishes a copy of the writer's deque as a new snapshot, in O(n). Returns
+ * its version. Only the writer may call this, preferably once per batch of
+ * updates.
+ */
+static inline uint64_t
+AADEQUE_NAME(_rcu_publish)(struct AADEQUE_NAME(_rcu) *r) {
+	struct AADEQUE_NAME(_snapshot) *s, *old;
+	AADEQUE_NAME(_rcu_reclaim)(r);
+	if (r->free) {
+		s = r->free;
+		r->free = s->next;
+		AADEQUE_NAME(_delete_all)(s->a);
+	}
+	else {
+		s = (struct AADEQUE_NAME(_snapshot) *)
+			AADEQUE_ALLOC(sizeof(struct AADEQUE_NAME(_snapshot)));
+		if (!s) AADEQUE_OOM();
+		s->a = AADEQUE_NAME(_create_empty)();
+	}
+	/* The copy starts at offset 0, so it is contiguous. */
+	s->a = AADEQUE_NAME(_make_space_after)(s->a, r->a->len);
+	AADEQUE_NAME(_copy_out)(r->a, 0, r->a->len, s->a->els);
+	s->version = ++r->version;
+	s->next = NULL;
+	old = atomic_exchange(&r->current, s);
+	/* Readers that start after this won't see old. */
+	old->retired = atomic_fetch_add(&r->epoch, 1);
+	old->next = r->retired;
+	r->retired = old;
+	return s->version;
+}
+
+/*
+ * Registers a reader. Returns the reader's slot, to be passed to the read
+ * functions, or -1 if there are already AADEQUE_RCU_MAX_READERS readers.
+ */
+static inline int
+AADEQUE_NAME(_rcu_register)(struct AADEQUE_NAME(_rcu) *r) {
+	int i;
+	for (i = 0; i < AADEQUE_RCU_MAX_READERS; i++) {
+		int expected = 0;
+		if (atomic_compare_exchange_strong(&r->slots[i].used, &expected, 1))
+			return i;
+	}
+	return -1;
+}
+
+/*
+ * Unregisters the reader in slot.
+ */
+static inline void
+AADEQUE_NAME(_rcu_unregister)(struct AADEQUE_NAME(_rcu) *r, int slot) {
+	atomic_store(&r->slots[slot].used, 0);
+}
+
+/*
+ * Returns the latest snapshot for the reader in slot. It stays valid and
+ * unchanged until aadeque_rcu_read_unlock() is called. Use the functions
+ * that don't modify the deque, such as aadeque_get and aadeque_span, on the
+ * snapshot's a.
+ */
+static inline struct AADEQUE_NAME(_snapshot) *
+AADEQUE_NAME(_rcu_read_lock)(struct AADEQUE_NAME(_rcu) *r, int slot) {
+	atomic_store(&r->slots[slot].epoch, atomic_load(&r->epoch));
+	return atomic_load(&r->current);
+}
+
+/*
+ * Ends the reading of the snapshot returned by aadeque_rcu_read_lock().
+ */
+static inline void
+AADEQUE_NAME(_rcu_read_unlock)(struct AADEQUE_NAME(_rcu) *r, int slot) {
+	atomic_store_explicit(&r->slots[slot].epoch, 0, memory_order_release);
+}
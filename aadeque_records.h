@@ -0,0 +1,163 @@
+/*
+ * aadeque_records.h - A deque of variable-length byte records
+ *
+ * The payloads of all records are stored back to back in an array deque of
+ * bytes. The end positions of the records are stored in a second array deque,
+ * which makes it possible to find the offset and length of any record in
+ * constant time. There is no allocation per record and the payloads can be
+ * accessed without copying, as one or two contiguous parts.
+ *
+ * The end positions are byte positions counted from the beginning of the
+ * first record ever pushed. They are allowed to wrap around the range of
+ * AADEQUE_SIZE_T, since only differences between them are used.
+ *
+ * This header instantiates aadeque.h with the prefixes aadeque_recends and
+ * aadeque_recbytes. The macros that configure an instantiation, such as
+ * AADEQUE_PREFIX and AADEQUE_ARITHMETIC, are saved before and restored after
+ * each of them, using aadeque_config_push.h and aadeque_config_pop.h, so your
+ * own definitions of them are unaffected.
+ *
+ * The author disclaims copyright to this source code.
+ */
+#ifndef AADEQUE_RECORDS_H
+#define AADEQUE_RECORDS_H
+
+/* The end positions of the records */
+#include "aadeque_config_push.h"
+#define AADEQUE_PREFIX aadeque_recends
+#define AADEQUE_VALUE_T AADEQUE_SIZE_T
+#include "aadeque.h"
+#include "aadeque_config_pop.h"
+
+/* The payload bytes, with the end positions in the header */
+#include "aadeque_config_push.h"
+#define AADEQUE_PREFIX aadeque_recbytes
+#define AADEQUE_VALUE_T unsigned char
+#define AADEQUE_HEADER \
+	struct aadeque_recends *ends; /* end position of each record */ \
+	AADEQUE_SIZE_T base;          /* position of the first byte */
+#include "aadeque.h"
+#include "aadeque_config_pop.h"
+
+/* The record deque is a byte deque with the record ends in the header. */
+typedef struct aadeque_recbytes aadeque_records_t;
+
+/*
+ * The payload of a record, in one or two contiguous parts. If the record
+ * doesn't wrap around the end of the underlying buffer, n[1] is 0.
+ */
+struct aadeque_records_view {
+	unsigned char *p[2];
+	AADEQUE_SIZE_T n[2];
+};
+
+/*
+ * Creates an empty record deque.
+ */
+static inline aadeque_records_t *
+aadeque_records_create_empty(void) {
+	aadeque_records_t *a = aadeque_recbytes_create_empty();
+	a->ends = aadeque_recends_create_empty();
+	a->base = 0;
+	return a;
+}
+
+/*
+ * Frees the memory.
+ */
+static inline void
+aadeque_records_destroy(aadeque_records_t *a) {
+	aadeque_recends_destroy(a->ends);
+	aadeque_recbytes_destroy(a);
+}
+
+/*
+ * Returns the number of records.
+ */
+static inline AADEQUE_SIZE_T
+aadeque_records_count(aadeque_records_t *a) {
+	return a->ends->len;
+}
+
+/*
+ * Returns the offset of record k within the payload bytes, i.e. the byte
+ * index of its first byte. The index bounds are not checked.
+ */
+static inline AADEQUE_SIZE_T
+aadeque_records_offset(aadeque_records_t *a, AADEQUE_SIZE_T k) {
+	if (k == 0)
+		return 0;
+	return aadeque_recends_get(a->ends, k - 1) - a->base;
+}
+
+/*
+ * Returns the length in bytes of record k. The index bounds are not checked.
+ */
+static inline AADEQUE_SIZE_T
+aadeque_records_len(aadeque_records_t *a, AADEQUE_SIZE_T k) {
+	return aadeque_recends_get(a->ends, k) - a->base -
+	       aadeque_records_offset(a, k);
+}
+
+/*
+ * Insert a record of n bytes, copied from data, at the end.
+ * May change aptr if it needs to be reallocated.
+ */
+static inline void
+aadeque_records_push(aadeque_records_t **aptr, const void *data,
+                     AADEQUE_SIZE_T n) {
+	aadeque_records_t *a = *aptr;
+	const unsigned char *src = (const unsigned char *)data;
+	AADEQUE_SIZE_T i = a->len, k;
+	a = aadeque_recbytes_make_space_after(a, n);
+	aadeque_recends_push(&a->ends, a->base + a->len);
+	while (n > 0) {
+		unsigned char *dst = aadeque_recbytes_span(a, i, n, &k);
+		memcpy(dst, src, k);
+		src += k;
+		i += k;
+		n -= k;
+	}
+	*aptr = a;
+}
+
+/*
+ * Gets the payload of record k, without copying, in view. Returns the length
+ * of the record. The pointers are valid until the record deque is modified.
+ * The index bounds are not checked.
+ */
+static inline AADEQUE_SIZE_T
+aadeque_records_peek(aadeque_records_t *a, AADEQUE_SIZE_T k,
+                     struct aadeque_records_view *view) {
+	AADEQUE_SIZE_T i = aadeque_records_offset(a, k),
+	               n = aadeque_records_len(a, k);
+	view->p[0] = aadeque_recbytes_span(a, i, n, &view->n[0]);
+	view->p[1] = aadeque_recbytes_span(a, i + view->n[0], n - view->n[0],
+	                                   &view->n[1]);
+	return n;
+}
+
+/*
+ * Remove the first record. If dst is not NULL, the payload is copied to dst,
+ * which must have room for it. Returns the length of the record.
+ * May change aptr if it needs to be reallocated.
+ */
+static inline AADEQUE_SIZE_T
+aadeque_records_shift(aadeque_records_t **aptr, void *dst) {
+	aadeque_records_t *a = *aptr;
+	AADEQUE_SIZE_T end = aadeque_recends_shift(&a->ends);
+	AADEQUE_SIZE_T n = end - a->base;
+	if (dst) {
+		struct aadeque_records_view view;
+		view.p[0] = aadeque_recbytes_span(a, 0, n, &view.n[0]);
+		view.p[1] = aadeque_recbytes_span(a, view.n[0], n - view.n[0],
+		                                  &view.n[1]);
+		memcpy(dst, view.p[0], view.n[0]);
+		memcpy((unsigned char *)dst + view.n[0], view.p[1], view.n[1]);
+	}
+	a->base = end;
+	*aptr = aadeque_recbytes_delete_first_n(a, n);
+	return n;
+}
+
+#endif
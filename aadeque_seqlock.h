@@ -0,0 +1,121 @@
+/*
+ * aadeque_seqlock.h - Ring of the last N values, for one writer and many readers
+ *
+ * A fixed-capacity ring, such as the last N samples of a metric, where one
+ * writer pushes values and any number of readers in other threads copy out
+ * windows of the latest values. The ring is an ordinary array deque that is
+ * never reallocated: when it's full, a push overwrites the oldest value.
+ *
+ * The writer never blocks or waits. It is protected by a sequence lock: a
+ * counter that the writer increments before and after each update, so it's
+ * odd while an update is in progress. A reader copies the values, using the
+ * two-part aadeque_copy_out(), and retries if the counter was odd or changed
+ * meanwhile. Readers don't write to any shared memory, so they don't contend
+ * with each other or with the writer.
+ *
+ * A reader may copy values while they are being overwritten (a race that the
+ * retry makes harmless), so a thread sanitizer will report the copies. The
+ * values must be plain data that can be copied in any state, such as numbers.
+ *
+ * This header is generic, like aadeque.h. Include it directly after including
+ * aadeque.h and the functions get the same prefix. Requires C11 atomics.
+ *
+ * The author disclaims copyright to this source code.
+ */
+
+#ifndef AADEQUE_SEQLOCK_COMMON
+#define AADEQUE_SEQLOCK_COMMON
+
+#include <stdatomic.h>
+
+/* Size of a cache line, tweakable. The counter is padded to this. */
+#ifndef AADEQUE_CACHE_LINE
+	#define AADEQUE_CACHE_LINE 64
+#endif
+
+#endif
+
+/* The ring */
+struct AADEQUE_NAME(_seqring) {
+	atomic_uint seq;                /* odd while the writer is updating */
+	char pad[AADEQUE_CACHE_LINE];
+	AADEQUE_T *a;                   /* never reallocated */
+};
+
+/*
+ * Creates an empty ring with room for cap values, or AADEQUE_MIN_CAPACITY
+ * values if cap is smaller.
+ */
+static inline struct AADEQUE_NAME(_seqring) *
+AADEQUE_NAME(_seqring_create)(AADEQUE_SIZE_T cap) {
+	struct AADEQUE_NAME(_seqring) *r = (struct AADEQUE_NAME(_seqring) *)
+		AADEQUE_ALLOC(sizeof(struct AADEQUE_NAME(_seqring)));
+	if (!r) AADEQUE_OOM();
+	atomic_init(&r->seq, 0);
+	r->a = AADEQUE_NAME(_create)(cap);
+	r->a->len = 0;
+	return r;
+}
+
+/*
+ * Frees the memory. No reader may be reading at this point.
+ */
+static inline void
+AADEQUE_NAME(_seqring_destroy)(struct AADEQUE_NAME(_seqring) *r) {
+	AADEQUE_NAME(_destroy)(r->a);
+	AADEQUE_FREE(r, sizeof(struct AADEQUE_NAME(_seqring)));
+}
+
+/*
+ * Inserts a value at the end, deleting the first value if the ring is full.
+ * Only the writer may call this.
+ */
+static inline void
+AADEQUE_NAME(_seqring_push)(struct AADEQUE_NAME(_seqring) *r,
+                            AADEQUE_VALUE_T value) {
+	AADEQUE_T *a = r->a;
+	unsigned s = atomic_load_explicit(&r->seq, memory_order_relaxed);
+	atomic_store_explicit(&r->seq, s + 1, memory_order_relaxed);
+	/* The odd counter is visible before any of the writes below. */
+	atomic_thread_fence(memory_order_release);
+	if (a->len < a->cap) {
+		a->els[AADEQUE_NAME(_idx)(a, a->len)] = value;
+		a->len++;
+	}
+	else {
+		/* Overwrite the first value, in place, without compacting. */
+		a->els[a->off] = value;
+		a->off = AADEQUE_NAME(_idx)(a, 1);
+		#ifdef AADEQUE_HANDLES
+		a->seq++;
+		#endif
+	}
+	atomic_store_explicit(&r->seq, s + 2, memory_order_release);
+}
+
+/*
+ * Copies the last n values, or all values if there are fewer than n, to dst,
+ * which must have room for n values. Returns the number of values copied. Any
+ * thread may call this. Retries until it gets a consistent copy.
+ */
+static inline AADEQUE_SIZE_T
+AADEQUE_NAME(_seqring_read_last)(struct AADEQUE_NAME(_seqring) *r,
+                                 AADEQUE_VALUE_T *dst, AADEQUE_SIZE_T n) {
+	AADEQUE_T *a = r->a;
+	unsigned s1, s2;
+	AADEQUE_SIZE_T len, k = 0;
+	do {
+		s1 = atomic_load_explicit(&r->seq, memory_order_acquire);
+		if (s1 & 1) {
+			s2 = s1 + 1;
+			continue;
+		}
+		len = a->len;
+		k = n < len ? n : len;
+		AADEQUE_NAME(_copy_out)(a, len - k, k, dst);
+		/* The copy is done before the counter is read again. */
+		atomic_thread_fence(memory_order_acquire);
+		s2 = atomic_load_explicit(&r->seq, memory_order_relaxed);
+	} while (s1 != s2);
+	return k;
+}
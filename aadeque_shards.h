@@ -0,0 +1,179 @@
+/*
+ * aadeque_shards.h - Sharded multi-queue with batch stealing
+ *
+ * A relaxed FIFO queue for many threads, made of N array deques (shards),
+ * typically one per thread or core. Each shard has its own spinlock, so
+ * threads working on different shards don't contend. A thread pushes to its
+ * own shard and shifts from its own shard first. When its own shard is empty,
+ * it steals half of the elements of another shard in one batch, so that it
+ * doesn't need to steal again for a while.
+ *
+ * The elements of each shard are shifted in FIFO order, but there is no
+ * ordering between shards.
+ *
+ * This header is generic, like aadeque.h. Include it directly after including
+ * aadeque.h and the functions get the same prefix. Requires C11 atomics.
+ *
+ * The author disclaims copyright to this source code.
+ */
+
+#ifndef AADEQUE_SHARDS_COMMON
+#define AADEQUE_SHARDS_COMMON
+
+#include <stdatomic.h>
+#include <sched.h>
+
+/* Size of a cache line, tweakable. Each shard is padded to at least this. */
+#ifndef AADEQUE_CACHE_LINE
+	#define AADEQUE_CACHE_LINE 64
+#endif
+
+/* A test-and-test-and-set spinlock, yielding while it's taken. */
+static inline void
+aadeque_spin_lock(atomic_int *l) {
+	while (atomic_exchange_explicit(l, 1, memory_order_acquire))
+		while (atomic_load_explicit(l, memory_order_relaxed))
+			sched_yield();
+}
+
+static inline void
+aadeque_spin_unlock(atomic_int *l) {
+	atomic_store_explicit(l, 0, memory_order_release);
+}
+
+#endif
+
+/* A shard. Used internally. */
+struct AADEQUE_NAME(_shard) {
+	atomic_int lock;
+	atomic_size_t len;      /* the length, readable without the lock */
+	AADEQUE_T *q;
+	char pad[AADEQUE_CACHE_LINE];
+};
+
+/* The sharded queue */
+struct AADEQUE_NAME(_shards) {
+	unsigned nshards;
+	struct AADEQUE_NAME(_shard) *shards;
+};
+
+/*
+ * Creates an empty queue with nshards shards.
+ */
+static inline struct AADEQUE_NAME(_shards) *
+AADEQUE_NAME(_shards_create)(unsigned nshards) {
+	struct AADEQUE_NAME(_shards) *s = (struct AADEQUE_NAME(_shards) *)
+		AADEQUE_ALLOC(sizeof(struct AADEQUE_NAME(_shards)));
+	unsigned i;
+	if (!s) AADEQUE_OOM();
+	s->nshards = nshards;
+	s->shards = (struct AADEQUE_NAME(_shard) *)
+		AADEQUE_ALLOC(sizeof(struct AADEQUE_NAME(_shard)) * nshards);
+	if (!s->shards) AADEQUE_OOM();
+	for (i = 0; i < nshards; i++) {
+		atomic_init(&s->shards[i].lock, 0);
+		atomic_init(&s->shards[i].len, 0);
+		s->shards[i].q = AADEQUE_NAME(_create_empty)();
+	}
+	return s;
+}
+
+/*
+ * Frees the memory. No other thread may use the queue at this point.
+ */
+static inline void
+AADEQUE_NAME(_shards_destroy)(struct AADEQUE_NAME(_shards) *s) {
+	unsigned i;
+	for (i = 0; i < s->nshards; i++)
+		AADEQUE_NAME(_destroy)(s->shards[i].q);
+	AADEQUE_FREE(s->shards, sizeof(struct AADEQUE_NAME(_shard)) * s->nshards);
+	AADEQUE_FREE(s, sizeof(struct AADEQUE_NAME(_shards)));
+}
+
+/*
+ * Returns the total number of elements. The result is only a snapshot if
+ * other threads are using the queue.
+ */
+static inline size_t
+AADEQUE_NAME(_shards_len)(struct AADEQUE_NAME(_shards) *s) {
+	size_t len = 0;
+	unsigned i;
+	for (i = 0; i < s->nshards; i++)
+		len += atomic_load_explicit(&s->shards[i].len, memory_order_relaxed);
+	return len;
+}
+
+/*
+ * Inserts a value at the end of shard i, usually the caller's own shard.
+ */
+static inline void
+AADEQUE_NAME(_shards_push)(struct AADEQUE_NAME(_shards) *s, unsigned i,
+                           AADEQUE_VALUE_T value) {
+	struct AADEQUE_NAME(_shard) *sh = &s->shards[i];
+	aadeque_spin_lock(&sh->lock);
+	AADEQUE_NAME(_push)(&sh->q, value);
+	atomic_store_explicit(&sh->len, sh->q->len, memory_order_relaxed);
+	aadeque_spin_unlock(&sh->lock);
+}
+
+/*
+ * Moves the first half, rounded up, of the elements of shard v to the end of
+ * shard i. Both locks must be held. Used internally.
+ */
+static inline void
+AADEQUE_NAME(_shards_move)(struct AADEQUE_NAME(_shards) *s, unsigned i,
+                           unsigned v) {
+	struct AADEQUE_NAME(_shard) *dst = &s->shards[i], *src = &s->shards[v];
+	AADEQUE_SIZE_T n = (src->q->len + 1) / 2, j = dst->q->len, m = n, k;
+	dst->q = AADEQUE_NAME(_make_space_after)(dst->q, n);
+	while (m > 0) {
+		AADEQUE_VALUE_T *p = AADEQUE_NAME(_span)(dst->q, j, m, &k);
+		AADEQUE_NAME(_copy_out)(src->q, n - m, k, p);
+		j += k;
+		m -= k;
+	}
+	src->q = AADEQUE_NAME(_delete_first_n)(src->q, n);
+	atomic_store_explicit(&src->len, src->q->len, memory_order_relaxed);
+}
+
+/*
+ * Removes the first value of shard i, usually the caller's own shard, and
+ * stores it in *value. If shard i is empty, half of the elements of another
+ * shard are moved to shard i first. Returns 1 on success and 0 if all shards
+ * are empty.
+ */
+static inline int
+AADEQUE_NAME(_shards_shift)(struct AADEQUE_NAME(_shards) *s, unsigned i,
+                            AADEQUE_VALUE_T *value) {
+	struct AADEQUE_NAME(_shard) *sh = &s->shards[i];
+	unsigned j;
+	aadeque_spin_lock(&sh->lock);
+	if (sh->q->len > 0) {
+		*value = AADEQUE_NAME(_shift)(&sh->q);
+		atomic_store_explicit(&sh->len, sh->q->len, memory_order_relaxed);
+		aadeque_spin_unlock(&sh->lock);
+		return 1;
+	}
+	aadeque_spin_unlock(&sh->lock);
+	/* Steal from the next non-empty shard, taking the locks in order. */
+	for (j = 1; j < s->nshards; j++) {
+		unsigned v = (i + j) % s->nshards;
+		struct AADEQUE_NAME(_shard) *vs = &s->shards[v];
+		if (atomic_load_explicit(&vs->len, memory_order_relaxed) == 0)
+			continue;
+		aadeque_spin_lock(v < i ? &vs->lock : &sh->lock);
+		aadeque_spin_lock(v < i ? &sh->lock : &vs->lock);
+		if (vs->q->len > 0)
+			AADEQUE_NAME(_shards_move)(s, i, v);
+		if (sh->q->len > 0) {
+			*value = AADEQUE_NAME(_shift)(&sh->q);
+			atomic_store_explicit(&sh->len, sh->q->len, memory_order_relaxed);
+			aadeque_spin_unlock(&vs->lock);
+			aadeque_spin_unlock(&sh->lock);
+			return 1;
+		}
+		aadeque_spin_unlock(&vs->lock);
+		aadeque_spin_unlock(&sh->lock);
+	}
+	return 0;
+}
@@ -0,0 +1,206 @@
+/*
+ * aadeque_ticket.h - Fixed-capacity ring with ticketed batch append
+ *
+ * A bounded ring buffer for many producers and a single consumer, where
+ * producers append values in batches. Only one thread at a time may take
+ * values; with more consumers, they must serialize aadeque_ticket_take() with
+ * a lock of their own. A producer reserves a contiguous run of k slots with a
+ * single atomic fetch-and-add, which gives it a ticket (the position of the
+ * first slot), fills the slots without any synchronisation and then commits
+ * them. This costs two atomic operations per batch rather than one or more
+ * per value.
+ *
+ * Commits are made in ticket order, so a producer that is done filling its
+ * slots waits for the producers before it to commit theirs. The consumer only
+ * sees committed values and it sees them in ticket order, so the values of
+ * each batch are contiguous and in order. A producer that reserves more slots
+ * than are free waits for the consumer to take values.
+ *
+ * The positions are counters that are never reset. The capacity is a power of
+ * two, so a position maps to a slot by masking.
+ *
+ * This header is generic, like aadeque.h. Include it directly after including
+ * aadeque.h and the functions get the same prefix. Only the value type is
+ * used; the ring is not an array deque. Requires C11 atomics.
+ *
+ * The author disclaims copyright to this source code.
+ */
+
+#ifndef AADEQUE_TICKET_COMMON
+#define AADEQUE_TICKET_COMMON
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <sched.h>
+
+/* Size of a cache line, tweakable. The counters are padded to this. */
+#ifndef AADEQUE_CACHE_LINE
+	#define AADEQUE_CACHE_LINE 64
+#endif
+
+/* Returned by aadeque_ticket_reserve() for a run larger than the capacity */
+#define AADEQUE_TICKET_NONE ((size_t)-1)
+
+#endif
+
+/* The ring */
+struct AADEQUE_NAME(_ticket) {
+	AADEQUE_SIZE_T cap;             /* a power of 2 */
+	atomic_size_t reserved;         /* the next ticket */
+	char pad1[AADEQUE_CACHE_LINE];
+	atomic_size_t committed;        /* values before this are committed */
+	char pad2[AADEQUE_CACHE_LINE];
+	atomic_size_t head;             /* values before this are taken */
+	char pad3[AADEQUE_CACHE_LINE];
+	AADEQUE_VALUE_T els[1];         /* elements, allocated in-place */
+};
+
+/* Size to allocate for a ring of capacity cap. Used internally. */
+static inline size_t
+AADEQUE_NAME(_ticket_sizeof)(AADEQUE_SIZE_T cap) {
+	return sizeof(struct AADEQUE_NAME(_ticket)) +
+	       (cap - 1) * sizeof(AADEQUE_VALUE_T);
+}
+
+/*
+ * Creates an empty ring with room for at least cap values. The capacity is
+ * rounded up to a power of 2.
+ */
+static inline struct AADEQUE_NAME(_ticket) *
+AADEQUE_NAME(_ticket_create)(AADEQUE_SIZE_T cap) {
+	struct AADEQUE_NAME(_ticket) *r;
+	AADEQUE_SIZE_T c = 1;
+	while (c < cap)
+		c <<= 1;
+	r = (struct AADEQUE_NAME(_ticket) *)
+		AADEQUE_ALLOC(AADEQUE_NAME(_ticket_sizeof)(c));
+	if (!r) AADEQUE_OOM();
+	r->cap = c;
+	atomic_init(&r->reserved, 0);
+	atomic_init(&r->committed, 0);
+	atomic_init(&r->head, 0);
+	return r;
+}
+
+/*
+ * Frees the memory. Values not taken are discarded.
+ */
+static inline void
+AADEQUE_NAME(_ticket_destroy)(struct AADEQUE_NAME(_ticket) *r) {
+	AADEQUE_FREE(r, AADEQUE_NAME(_ticket_sizeof)(r->cap));
+}
+
+/*
+ * Returns the number of committed values not yet taken.
+ */
+static inline size_t
+AADEQUE_NAME(_ticket_len)(struct AADEQUE_NAME(_ticket) *r) {
+	return atomic_load_explicit(&r->committed, memory_order_acquire) -
+	       atomic_load_explicit(&r->head, memory_order_acquire);
+}
+
+/*
+ * Reserves k contiguous slots and returns the ticket, the position of the
+ * first one. Waits until the slots are free. The slots must be filled using
+ * aadeque_ticket_span() or aadeque_ticket_put() and then committed using
+ * aadeque_ticket_commit().
+ *
+ * If k is larger than the capacity, the slots could never be free, so nothing
+ * is reserved and AADEQUE_TICKET_NONE is returned.
+ */
+static inline size_t
+AADEQUE_NAME(_ticket_reserve)(struct AADEQUE_NAME(_ticket) *r,
+                              AADEQUE_SIZE_T k) {
+	size_t t;
+	/* Checked before taking tickets, which would block later producers. */
+	if (k > r->cap)
+		return AADEQUE_TICKET_NONE;
+	t = atomic_fetch_add_explicit(&r->reserved, k, memory_order_relaxed);
+	/* Acquire, so the consumer is done with the slots before we reuse them. */
+	while (t + k - atomic_load_explicit(&r->head, memory_order_acquire) >
+	       r->cap)
+		sched_yield();
+	return t;
+}
+
+/*
+ * Returns a pointer to the slot at position pos, within a reserved run, and
+ * stores in *k the number of slots from there to the end of the run of n
+ * slots or to the end of the buffer, whichever comes first. A run can be
+ * wrapped around the end of the buffer, so it's at most two spans.
+ */
+static inline AADEQUE_VALUE_T *
+AADEQUE_NAME(_ticket_span)(struct AADEQUE_NAME(_ticket) *r, size_t pos,
+                           AADEQUE_SIZE_T n, AADEQUE_SIZE_T *k) {
+	AADEQUE_SIZE_T i = (AADEQUE_SIZE_T)(pos & (r->cap - 1));
+	*k = r->cap - i < n ? r->cap - i : n;
+	return &r->els[i];
+}
+
+/*
+ * Copies n values into the reserved slots starting at position pos.
+ */
+static inline void
+AADEQUE_NAME(_ticket_put)(struct AADEQUE_NAME(_ticket) *r, size_t pos,
+                          const AADEQUE_VALUE_T *values, AADEQUE_SIZE_T n) {
+	while (n > 0) {
+		AADEQUE_SIZE_T k;
+		AADEQUE_VALUE_T *p = AADEQUE_NAME(_ticket_span)(r, pos, n, &k);
+		memcpy(p, values, sizeof(AADEQUE_VALUE_T) * k);
+		values += k;
+		pos += k;
+		n -= k;
+	}
+}
+
+/*
+ * Commits the k slots reserved with ticket t, making them visible to the
+ * consumer. Waits for the slots reserved before them to be committed.
+ */
+static inline void
+AADEQUE_NAME(_ticket_commit)(struct AADEQUE_NAME(_ticket) *r, size_t t,
+                             AADEQUE_SIZE_T k) {
+	while (atomic_load_explicit(&r->committed, memory_order_acquire) != t)
+		sched_yield();
+	atomic_store_explicit(&r->committed, t + k, memory_order_release);
+}
+
+/*
+ * Appends n values from an array as one batch, i.e. reserves, copies and
+ * commits. Returns 1, or 0 without appending anything if n is larger than the
+ * capacity. Any producer may call this.
+ */
+static inline int
+AADEQUE_NAME(_ticket_push_n)(struct AADEQUE_NAME(_ticket) *r,
+                             const AADEQUE_VALUE_T *values, AADEQUE_SIZE_T n) {
+	size_t t = AADEQUE_NAME(_ticket_reserve)(r, n);
+	if (t == AADEQUE_TICKET_NONE)
+		return 0;
+	AADEQUE_NAME(_ticket_put)(r, t, values, n);
+	AADEQUE_NAME(_ticket_commit)(r, t, n);
+	return 1;
+}
+
+/*
+ * Takes up to max committed values, copying them to an array, and returns the
+ * number of values taken. Doesn't wait. Only the consumer may call this.
+ */
+static inline AADEQUE_SIZE_T
+AADEQUE_NAME(_ticket_take)(struct AADEQUE_NAME(_ticket) *r,
+                           AADEQUE_VALUE_T *values, AADEQUE_SIZE_T max) {
+	size_t h = atomic_load_explicit(&r->head, memory_order_relaxed);
+	size_t c = atomic_load_explicit(&r->committed, memory_order_acquire);
+	AADEQUE_SIZE_T n = c - h < max ? (AADEQUE_SIZE_T)(c - h) : max;
+	AADEQUE_SIZE_T left = n;
+	while (left > 0) {
+		AADEQUE_SIZE_T k;
+		AADEQUE_VALUE_T *p = AADEQUE_NAME(_ticket_span)(r, h, left, &k);
+		memcpy(values, p, sizeof(AADEQUE_VALUE_T) * k);
+		values += k;
+		h += k;
+		left -= k;
+	}
+	/* Release, so the values are copied before producers reuse the slots. */
+	atomic_store_explicit(&r->head, h, memory_order_release);
+	return n;
+}
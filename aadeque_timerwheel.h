@@ -0,0 +1,190 @@
+/*
+ * aadeque_timerwheel.h - Hierarchical timer wheel
+ *
+ * Time is counted in ticks. There are AADEQUE_TIMERWHEEL_LEVELS levels of 64
+ * slots each. A slot at level 0 covers one tick, a slot at level 1 covers 64
+ * ticks, and so on. A timer is put in the slot of the lowest level whose range
+ * from the current time covers its expiry time, which is O(1). Each time a
+ * lower level wraps around, the timers in the current slot of the level above
+ * are moved down (cascaded) to lower levels. Timers further away than the
+ * range of the highest level are put in its furthest slot and rescheduled
+ * when that slot is cascaded.
+ *
+ * Each slot is an array deque of timer records, stored by value. When a slot
+ * expires, all its timers are passed to the callback and then removed at once
+ * with aadeque_timerslot_delete_all(), which keeps the capacity. The drained
+ * slot is swapped with a spare empty one before the callbacks are called and
+ * becomes the new spare afterwards, so there is no allocation in steady state.
+ *
+ * This header instantiates aadeque.h with the prefix aadeque_timerslot. The
+ * macros that configure an instantiation, such as AADEQUE_PREFIX and
+ * AADEQUE_ARITHMETIC, are saved before and restored after it, using
+ * aadeque_config_push.h and aadeque_config_pop.h, so your own definitions of
+ * them are unaffected.
+ *
+ * The author disclaims copyright to this source code.
+ */
+#ifndef AADEQUE_TIMERWHEEL_H
+#define AADEQUE_TIMERWHEEL_H
+
+#include <stdint.h>
+
+/* The number of levels, tweakable. The range is 64^levels ticks. */
+#ifndef AADEQUE_TIMERWHEEL_LEVELS
+	#define AADEQUE_TIMERWHEEL_LEVELS 4
+#endif
+
+/* A timer record */
+struct aadeque_timer {
+	uint64_t expires;   /* the tick when the timer expires */
+	void *data;         /* user data */
+};
+
+#include "aadeque_config_push.h"
+#define AADEQUE_PREFIX aadeque_timerslot
+#define AADEQUE_VALUE_T struct aadeque_timer
+#define AADEQUE_EQ(x, y) ((x).expires == (y).expires && (x).data == (y).data)
+#define AADEQUE_LT(x, y) ((x).expires < (y).expires)
+#include "aadeque.h"
+#include "aadeque_config_pop.h"
+
+/* The timer wheel */
+typedef struct aadeque_timerwheel {
+	uint64_t now;                   /* the current tick */
+	AADEQUE_SIZE_T len;             /* number of timers */
+	struct aadeque_timerslot *spare; /* an empty slot, swapped in on drain */
+	struct aadeque_timerslot *slots[AADEQUE_TIMERWHEEL_LEVELS][64];
+} aadeque_timerwheel_t;
+
+/*
+ * Creates a timer wheel with no timers, with the current time now.
+ */
+static inline aadeque_timerwheel_t *
+aadeque_timerwheel_create(uint64_t now) {
+	aadeque_timerwheel_t *w =
+		(aadeque_timerwheel_t *)AADEQUE_ALLOC(sizeof(aadeque_timerwheel_t));
+	int l, i;
+	if (!w) AADEQUE_OOM();
+	w->now = now;
+	w->len = 0;
+	w->spare = aadeque_timerslot_create_empty();
+	for (l = 0; l < AADEQUE_TIMERWHEEL_LEVELS; l++)
+		for (i = 0; i < 64; i++)
+			w->slots[l][i] = aadeque_timerslot_create_empty();
+	return w;
+}
+
+/*
+ * Frees the memory. Any timers left are discarded.
+ */
+static inline void
+aadeque_timerwheel_destroy(aadeque_timerwheel_t *w) {
+	int l, i;
+	for (l = 0; l < AADEQUE_TIMERWHEEL_LEVELS; l++)
+		for (i = 0; i < 64; i++)
+			aadeque_timerslot_destroy(w->slots[l][i]);
+	aadeque_timerslot_destroy(w->spare);
+	AADEQUE_FREE(w, sizeof(aadeque_timerwheel_t));
+}
+
+/*
+ * Returns the number of scheduled timers.
+ */
+static inline AADEQUE_SIZE_T
+aadeque_timerwheel_len(aadeque_timerwheel_t *w) {
+	return w->len;
+}
+
+/*
+ * Puts a timer in the slot for the tick when, which must not be before the
+ * current tick, without counting it. Used internally.
+ */
+static inline void
+aadeque_timerwheel_insert(aadeque_timerwheel_t *w, struct aadeque_timer t,
+                          uint64_t when) {
+	uint64_t diff = when - w->now;
+	int l;
+	for (l = 0; l < AADEQUE_TIMERWHEEL_LEVELS - 1; l++)
+		if (diff < (uint64_t)1 << (6 * (l + 1)))
+			break;
+	if (diff >= (uint64_t)1 << (6 * (l + 1)))
+		/* Too far away. Use the furthest slot and reschedule later. */
+		when = w->now + ((uint64_t)1 << (6 * (l + 1))) - 1;
+	aadeque_timerslot_push(&w->slots[l][(when >> (6 * l)) & 63], t);
+}
+
+/*
+ * Schedules a timer to expire at the tick expires, with user data data. A
+ * timer that expires at or before the current tick expires on the next call
+ * to advance.
+ */
+static inline void
+aadeque_timerwheel_schedule(aadeque_timerwheel_t *w, uint64_t expires,
+                            void *data) {
+	struct aadeque_timer t;
+	t.expires = expires;
+	t.data = data;
+	/* The current tick has been processed. Earlier timers go to the next. */
+	aadeque_timerwheel_insert(w, t, expires > w->now ? expires : w->now + 1);
+	w->len++;
+}
+
+/*
+ * Removes all timers from slot i at level l, without copying them, replacing
+ * it with the spare. Returns the detached slot. Used internally.
+ */
+static inline struct aadeque_timerslot *
+aadeque_timerwheel_detach(aadeque_timerwheel_t *w, int l, int i) {
+	struct aadeque_timerslot *s = w->slots[l][i];
+	w->slots[l][i] = w->spare;
+	return s;
+}
+
+/*
+ * Advances the current time to now, one tick at a time. For each timer that
+ * expires, fn is called with the timer and ctx. The callback may schedule new
+ * timers, but it must not call advance. Returns the number of expired timers.
+ */
+static inline AADEQUE_SIZE_T
+aadeque_timerwheel_advance(aadeque_timerwheel_t *w, uint64_t now,
+                           void (*fn)(struct aadeque_timer *, void *),
+                           void *ctx) {
+	AADEQUE_SIZE_T expired = 0, i, n, k;
+	while (w->now < now) {
+		struct aadeque_timerslot *s;
+		int l;
+		w->now++;
+		/*
+		 * Cascade the levels above each level that has wrapped around. Timers
+		 * that expire now end up in the current slot at level 0.
+		 */
+		for (l = 1; l < AADEQUE_TIMERWHEEL_LEVELS; l++) {
+			if ((w->now & (((uint64_t)1 << (6 * l)) - 1)) != 0)
+				break;
+			s = aadeque_timerwheel_detach(w, l, (w->now >> (6 * l)) & 63);
+			for (i = 0, n = s->len; n > 0; i += k, n -= k) {
+				struct aadeque_timer *p = aadeque_timerslot_span(s, i, n, &k);
+				AADEQUE_SIZE_T j;
+				for (j = 0; j < k; j++)
+					aadeque_timerwheel_insert(w, p[j], p[j].expires);
+			}
+			aadeque_timerslot_delete_all(s);
+			w->spare = s;
+		}
+		/* Expire the timers in the current slot at level 0. */
+		s = aadeque_timerwheel_detach(w, 0, w->now & 63);
+		for (i = 0, n = s->len; n > 0; i += k, n -= k) {
+			struct aadeque_timer *p = aadeque_timerslot_span(s, i, n, &k);
+			AADEQUE_SIZE_T j;
+			for (j = 0; j < k; j++)
+				fn(&p[j], ctx);
+		}
+		expired += s->len;
+		w->len -= s->len;
+		aadeque_timerslot_delete_all(s);
+		w->spare = s;
+	}
+	return expired;
+}
+
+#endif
@@ -0,0 +1,303 @@
+/*
+ * aadeque_uring.h - Streaming I/O with io_uring into and out of byte deques
+ *
+ * An adapter for reading from and writing to file descriptors with io_uring
+ * (Linux 5.6 or later), using array deques of bytes as buffers. A read is
+ * submitted as a readv with one iovec for each contiguous part of the free
+ * space after the last element, and a write as a writev with one iovec for
+ * each contiguous part of the elements, so nothing is copied. Many reads and
+ * writes can be queued and then submitted with a single system call, which
+ * can also wait for completions.
+ *
+ * When a read completes, the bytes read are added to the deque using
+ * aadeque_make_space_after(). When a write completes, the bytes written are
+ * removed from the front using aadeque_delete_first_n(). The space for a read
+ * is reserved when the read is submitted, so the buffer is not reallocated
+ * while a read or a write is in flight. Thus, one read and one write can be in
+ * flight for the same deque, e.g. when a proxy forwards data from one socket
+ * to another.
+ *
+ * The buffers are not registered with the kernel (fixed buffers), since the
+ * buffer of an array deque moves when it grows and would have to be
+ * registered again.
+ *
+ * The ring itself is set up with the raw system calls, so liburing is not
+ * needed.
+ *
+ * This header is generic, like aadeque.h. Include it directly after including
+ * aadeque.h with a byte type as AADEQUE_VALUE_T and the functions get the same
+ * prefix.
+ *
+ * The author disclaims copyright to this source code.
+ */
+
+#ifndef AADEQUE_URING_COMMON
+#define AADEQUE_URING_COMMON
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <string.h>
+
+/* An io_uring instance, with its submission and completion queues mapped */
+struct aadeque_uring {
+	int fd;
+	unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	unsigned sq_entries;
+	unsigned sqe_tail;          /* the tail including queued SQEs */
+	unsigned to_submit;         /* number of queued SQEs */
+	void *sq_ring, *cq_ring;
+	size_t sq_ring_size, cq_ring_size;
+};
+
+/*
+ * Sets up ring with room for at least entries SQEs. Returns 0 on success and
+ * -1 with errno set if io_uring is not available.
+ */
+static inline int
+aadeque_uring_init(struct aadeque_uring *ring, unsigned entries) {
+	struct io_uring_params p;
+	char *sq, *cq;
+	memset(&p, 0, sizeof(p));
+	memset(ring, 0, sizeof(*ring));
+	ring->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+	if (ring->fd < 0)
+		return -1;
+	ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	ring->cq_ring_size = p.cq_off.cqes +
+	                     p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->cq_ring_size > ring->sq_ring_size)
+			ring->sq_ring_size = ring->cq_ring_size;
+		ring->cq_ring_size = 0;
+	}
+	ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+	                     MAP_SHARED | MAP_POPULATE, ring->fd,
+	                     IORING_OFF_SQ_RING);
+	if (ring->sq_ring == MAP_FAILED)
+		goto fail;
+	ring->cq_ring = ring->sq_ring;
+	if (ring->cq_ring_size > 0) {
+		ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+		                     MAP_SHARED | MAP_POPULATE, ring->fd,
+		                     IORING_OFF_CQ_RING);
+		if (ring->cq_ring == MAP_FAILED)
+			goto fail_sq;
+	}
+	ring->sqes = (struct io_uring_sqe *)
+		mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+		     PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+		     IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED)
+		goto fail_cq;
+	sq = (char *)ring->sq_ring;
+	cq = (char *)ring->cq_ring;
+	ring->sq_head = (unsigned *)(sq + p.sq_off.head);
+	ring->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+	ring->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+	ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+	ring->cq_head = (unsigned *)(cq + p.cq_off.head);
+	ring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+	ring->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	ring->sq_entries = p.sq_entries;
+	ring->sqe_tail = *ring->sq_tail;
+	return 0;
+fail_cq:
+	if (ring->cq_ring_size > 0)
+		munmap(ring->cq_ring, ring->cq_ring_size);
+fail_sq:
+	munmap(ring->sq_ring, ring->sq_ring_size);
+fail:
+	close(ring->fd);
+	return -1;
+}
+
+/*
+ * Unmaps and closes the ring.
+ */
+static inline void
+aadeque_uring_exit(struct aadeque_uring *ring) {
+	munmap(ring->sqes, ring->sq_entries * sizeof(struct io_uring_sqe));
+	if (ring->cq_ring_size > 0)
+		munmap(ring->cq_ring, ring->cq_ring_size);
+	munmap(ring->sq_ring, ring->sq_ring_size);
+	close(ring->fd);
+}
+
+/*
+ * Returns a zeroed SQE to fill in, queued for the next submit, or NULL if the
+ * submission queue is full.
+ */
+static inline struct io_uring_sqe *
+aadeque_uring_get_sqe(struct aadeque_uring *ring) {
+	unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+	unsigned i;
+	if (ring->sqe_tail - head >= ring->sq_entries)
+		return NULL;
+	i = ring->sqe_tail++ & *ring->sq_mask;
+	ring->sq_array[i] = i;
+	ring->to_submit++;
+	memset(&ring->sqes[i], 0, sizeof(struct io_uring_sqe));
+	return &ring->sqes[i];
+}
+
+/*
+ * Submits the queued SQEs and waits until at least wait_nr completions are
+ * available, in one system call. Returns the number of SQEs submitted or -1
+ * with errno set.
+ */
+static inline int
+aadeque_uring_submit(struct aadeque_uring *ring, unsigned wait_nr) {
+	int r;
+	__atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+	r = (int)syscall(__NR_io_uring_enter, ring->fd, ring->to_submit, wait_nr,
+	                 wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+	if (r > 0)
+		ring->to_submit -= r;
+	return r;
+}
+
+/*
+ * Takes the next completion, if any, and stores it in *cqe. Returns 1 if a
+ * completion was taken and 0 if there are none.
+ */
+static inline int
+aadeque_uring_next(struct aadeque_uring *ring, struct io_uring_cqe *cqe) {
+	unsigned head = *ring->cq_head;
+	if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+		return 0;
+	*cqe = ring->cqes[head & *ring->cq_mask];
+	__atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+#endif
+
+/* A byte deque used for I/O, with the state of the reads and writes on it */
+struct AADEQUE_NAME(_io) {
+	AADEQUE_T *a;
+	AADEQUE_SIZE_T reading;     /* size of the read in flight, or 0 */
+	AADEQUE_SIZE_T writing;     /* size of the write in flight, or 0 */
+	struct iovec riov[2];       /* the iovecs of the read in flight */
+	struct iovec wiov[2];       /* the iovecs of the write in flight */
+};
+
+/*
+ * Queues a read of up to n bytes from fd to the end of io->a, with user_data
+ * to identify the completion. The space is reserved now, unless a write is in
+ * flight, in which case only the space already available is used. Returns the
+ * number of bytes requested, or 0 if no read was queued because the submission
+ * queue is full, a read is in flight or there is no free space.
+ */
+static inline AADEQUE_SIZE_T
+AADEQUE_NAME(_io_read)(struct aadeque_uring *ring, struct AADEQUE_NAME(_io) *io,
+                       int fd, AADEQUE_SIZE_T n, uint64_t user_data) {
+	struct io_uring_sqe *sqe;
+	AADEQUE_SIZE_T i, k, avail;
+	int niov = 0;
+	if (io->reading)
+		return 0;
+	if (!io->writing)
+		io->a = AADEQUE_NAME(_reserve)(io->a, n);
+	avail = io->a->cap - io->a->len;
+	if (n > avail)
+		n = avail;
+	if (n == 0 || !(sqe = aadeque_uring_get_sqe(ring)))
+		return 0;
+	/* The free space starts after the last element and may wrap around. */
+	for (i = io->a->len; i < io->a->len + n; i += k) {
+		AADEQUE_SIZE_T j = AADEQUE_NAME(_idx)(io->a, i);
+		k = io->a->cap - j;
+		if (k > io->a->len + n - i)
+			k = io->a->len + n - i;
+		io->riov[niov].iov_base = &io->a->els[j];
+		io->riov[niov].iov_len = k * sizeof(AADEQUE_VALUE_T);
+		niov++;
+	}
+	sqe->opcode = IORING_OP_READV;
+	sqe->fd = fd;
+	sqe->addr = (uint64_t)(uintptr_t)io->riov;
+	sqe->len = niov;
+	sqe->off = (uint64_t)-1;    /* the current position */
+	sqe->user_data = user_data;
+	io->reading = n;
+	return n;
+}
+
+/*
+ * Queues a write of all bytes in io->a to fd, with user_data to identify the
+ * completion. Returns the number of bytes requested, or 0 if no write was
+ * queued because the submission queue is full, a write is in flight or the
+ * deque is empty.
+ */
+static inline AADEQUE_SIZE_T
+AADEQUE_NAME(_io_write)(struct aadeque_uring *ring,
+                        struct AADEQUE_NAME(_io) *io, int fd,
+                        uint64_t user_data) {
+	struct io_uring_sqe *sqe;
+	AADEQUE_SIZE_T i, k, n = io->a->len;
+	int niov = 0;
+	if (io->writing || n == 0 || !(sqe = aadeque_uring_get_sqe(ring)))
+		return 0;
+	for (i = 0; i < n; i += k) {
+		io->wiov[niov].iov_base = AADEQUE_NAME(_span)(io->a, i, n - i, &k);
+		io->wiov[niov].iov_len = k * sizeof(AADEQUE_VALUE_T);
+		niov++;
+	}
+	sqe->opcode = IORING_OP_WRITEV;
+	sqe->fd = fd;
+	sqe->addr = (uint64_t)(uintptr_t)io->wiov;
+	sqe->len = niov;
+	sqe->off = (uint64_t)-1;
+	sqe->user_data = user_data;
+	io->writing = n;
+	return n;
+}
+
+/*
+ * Completes the read in flight, with the result res of its completion. The
+ * bytes read are added to the end of io->a. Returns res.
+ */
+static inline int
+AADEQUE_NAME(_io_read_done)(struct AADEQUE_NAME(_io) *io, int res) {
+	if (res > 0)
+		/* The space is reserved, so this doesn't reallocate. */
+		io->a = AADEQUE_NAME(_make_space_after)(io->a,
+			(AADEQUE_SIZE_T)res / sizeof(AADEQUE_VALUE_T));
+	io->reading = 0;
+	return res;
+}
+
+/*
+ * Completes the write in flight, with the result res of its completion. The
+ * bytes written are removed from the front of io->a. Returns res.
+ */
+static inline int
+AADEQUE_NAME(_io_write_done)(struct AADEQUE_NAME(_io) *io, int res) {
+	io->writing = 0;
+	if (res <= 0)
+		return res;
+	if (io->reading) {
+		/*
+		 * Delete without compacting, since a read is in flight into the free
+		 * space. The remaining elements stay where they are.
+		 */
+		io->a->off = AADEQUE_NAME(_idx)(io->a,
+			(AADEQUE_SIZE_T)res / sizeof(AADEQUE_VALUE_T));
+		io->a->len -= (AADEQUE_SIZE_T)res / sizeof(AADEQUE_VALUE_T);
+		#ifdef AADEQUE_HANDLES
+		io->a->seq += (AADEQUE_SIZE_T)res / sizeof(AADEQUE_VALUE_T);
+		#endif
+	}
+	else {
+		io->a = AADEQUE_NAME(_delete_first_n)(io->a,
+			(AADEQUE_SIZE_T)res / sizeof(AADEQUE_VALUE_T));
+	}
+	return res;
+}
@@ -0,0 +1,201 @@
+/*
+ * aadeque_ws.h - A work-stealing deque
+ *
+ * This is a concurrent variant of the array deque for work-stealing
+ * schedulers (the Chase-Lev deque, using C11 atomics as described by Le,
+ * Pop, Cohen and Zappa Nardelli in "Correct and Efficient Work-Stealing for
+ * Weak Memory Models", 2013).
+ *
+ * One thread, the owner, pushes and pops values at the bottom end. Any other
+ * thread may steal values from the top end. Like struct aadeque, the values
+ * are stored in a circular buffer whose capacity is a power of 2 and which
+ * grows when full. Since a thief may still be reading the old buffer when it
+ * is replaced, the old buffers are kept until the deque is destroyed. The
+ * buffer never shrinks.
+ *
+ * The values are of type void *. This header requires C11 atomics.
+ *
+ * The author disclaims copyright to this source code.
+ */
+#ifndef AADEQUE_WS_H
+#define AADEQUE_WS_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+/* allocation macros, tweakable, as in aadeque.h */
+#ifndef AADEQUE_ALLOC
+	#define AADEQUE_ALLOC(size) malloc(size)
+#endif
+#ifndef AADEQUE_FREE
+	#define AADEQUE_FREE(ptr, size) free(ptr)
+#endif
+#ifndef AADEQUE_OOM
+	#define AADEQUE_OOM() exit(-1)
+#endif
+
+/* Return values of aadeque_ws_steal() */
+#define AADEQUE_WS_OK    0  /* a value was stolen */
+#define AADEQUE_WS_EMPTY 1  /* there was nothing to steal */
+#define AADEQUE_WS_ABORT 2  /* lost a race with another thread, try again */
+
+/* A circular buffer. Used internally. */
+struct aadeque_ws_buf {
+	ptrdiff_t cap;                  /* capacity, a power of 2 */
+	struct aadeque_ws_buf *prev;    /* the replaced buffer, freed on destroy */
+	_Atomic(void *) els[1];         /* elements, allocated in-place */
+};
+
+/* The work-stealing deque */
+typedef struct aadeque_ws {
+	atomic_ptrdiff_t top;           /* steal end, only incremented */
+	atomic_ptrdiff_t bottom;        /* owner end */
+	_Atomic(struct aadeque_ws_buf *) buf;
+} aadeque_ws_t;
+
+/* Size to allocate for a buffer of capacity cap. Used internally. */
+static inline size_t
+aadeque_ws_sizeof(ptrdiff_t cap) {
+	return sizeof(struct aadeque_ws_buf) + (cap - 1) * sizeof(_Atomic(void *));
+}
+
+/* Allocates a buffer. Used internally. */
+static inline struct aadeque_ws_buf *
+aadeque_ws_buf_create(ptrdiff_t cap, struct aadeque_ws_buf *prev) {
+	struct aadeque_ws_buf *b =
+		(struct aadeque_ws_buf *)AADEQUE_ALLOC(aadeque_ws_sizeof(cap));
+	if (!b) AADEQUE_OOM();
+	b->cap = cap;
+	b->prev = prev;
+	return b;
+}
+
+/*
+ * Creates an empty work-stealing deque with an initial capacity of cap, which
+ * must be a power of 2.
+ */
+static inline aadeque_ws_t *
+aadeque_ws_create(ptrdiff_t cap) {
+	aadeque_ws_t *q = (aadeque_ws_t *)AADEQUE_ALLOC(sizeof(aadeque_ws_t));
+	if (!q) AADEQUE_OOM();
+	atomic_init(&q->top, 0);
+	atomic_init(&q->bottom, 0);
+	atomic_init(&q->buf, aadeque_ws_buf_create(cap, NULL));
+	return q;
+}
+
+/*
+ * Frees the memory, including the replaced buffers. No other thread may use
+ * the deque at this point.
+ */
+static inline void
+aadeque_ws_destroy(aadeque_ws_t *q) {
+	struct aadeque_ws_buf *b = atomic_load_explicit(&q->buf,
+	                                                memory_order_relaxed);
+	while (b) {
+		struct aadeque_ws_buf *prev = b->prev;
+		AADEQUE_FREE(b, aadeque_ws_sizeof(b->cap));
+		b = prev;
+	}
+	AADEQUE_FREE(q, sizeof(aadeque_ws_t));
+}
+
+/*
+ * Returns the number of values. The result is only a snapshot if other
+ * threads are stealing.
+ */
+static inline ptrdiff_t
+aadeque_ws_len(aadeque_ws_t *q) {
+	ptrdiff_t b = atomic_load_explicit(&q->bottom, memory_order_relaxed);
+	ptrdiff_t t = atomic_load_explicit(&q->top, memory_order_relaxed);
+	return b > t ? b - t : 0;
+}
+
+/*
+ * Inserts a value at the bottom. Only the owner may call this.
+ */
+static inline void
+aadeque_ws_push(aadeque_ws_t *q, void *value) {
+	ptrdiff_t b = atomic_load_explicit(&q->bottom, memory_order_relaxed);
+	ptrdiff_t t = atomic_load_explicit(&q->top, memory_order_acquire);
+	struct aadeque_ws_buf *a = atomic_load_explicit(&q->buf,
+	                                                memory_order_relaxed);
+	if (b - t > a->cap - 1) {
+		/* Full. Copy the values to a buffer of twice the capacity. */
+		struct aadeque_ws_buf *na = aadeque_ws_buf_create(a->cap << 1, a);
+		ptrdiff_t i;
+		for (i = t; i < b; i++)
+			atomic_store_explicit(&na->els[i & (na->cap - 1)],
+				atomic_load_explicit(&a->els[i & (a->cap - 1)],
+				                     memory_order_relaxed),
+				memory_order_relaxed);
+		atomic_store_explicit(&q->buf, na, memory_order_release);
+		a = na;
+	}
+	atomic_store_explicit(&a->els[b & (a->cap - 1)], value,
+	                      memory_order_relaxed);
+	/* Publishes the value, and what it points to, to the thieves. */
+	atomic_store_explicit(&q->bottom, b + 1, memory_order_release);
+}
+
+/*
+ * Removes a value from the bottom and stores it in *value. Returns 1 on
+ * success and 0 if the deque is empty. Only the owner may call this.
+ */
+static inline int
+aadeque_ws_pop(aadeque_ws_t *q, void **value) {
+	ptrdiff_t b = atomic_load_explicit(&q->bottom, memory_order_relaxed) - 1;
+	struct aadeque_ws_buf *a = atomic_load_explicit(&q->buf,
+	                                                memory_order_relaxed);
+	ptrdiff_t t;
+	int ok = 1;
+	atomic_store_explicit(&q->bottom, b, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+	t = atomic_load_explicit(&q->top, memory_order_relaxed);
+	if (t <= b) {
+		*value = atomic_load_explicit(&a->els[b & (a->cap - 1)],
+		                              memory_order_relaxed);
+		if (t == b) {
+			/* The last value. Race against the thieves for it. */
+			if (!atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1,
+			                                             memory_order_seq_cst,
+			                                             memory_order_relaxed))
+				ok = 0;
+			atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+		}
+	}
+	else {
+		ok = 0;
+		atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+	}
+	return ok;
+}
+
+/*
+ * Removes a value from the top and stores it in *value. Any thread may call
+ * this. Returns AADEQUE_WS_OK, AADEQUE_WS_EMPTY or AADEQUE_WS_ABORT if another
+ * thread took the value first.
+ */
+static inline int
+aadeque_ws_steal(aadeque_ws_t *q, void **value) {
+	ptrdiff_t t = atomic_load_explicit(&q->top, memory_order_acquire);
+	ptrdiff_t b;
+	atomic_thread_fence(memory_order_seq_cst);
+	b = atomic_load_explicit(&q->bottom, memory_order_acquire);
+	if (t < b) {
+		struct aadeque_ws_buf *a = atomic_load_explicit(&q->buf,
+		                                                memory_order_acquire);
+		void *x = atomic_load_explicit(&a->els[t & (a->cap - 1)],
+		                               memory_order_relaxed);
+		if (!atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1,
+		                                             memory_order_seq_cst,
+		                                             memory_order_relaxed))
+			return AADEQUE_WS_ABORT;
+		*value = x;
+		return AADEQUE_WS_OK;
+	}
+	return AADEQUE_WS_EMPTY;
+}
+
+#endif
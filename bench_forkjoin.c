@@ -0,0 +1,249 @@
+/*
+ * Benchmarks for aadeque_forkjoin.h
+ *
+ * Compile and run:
+ *
+ *     gcc -O2 -std=c11 -pthread bench_forkjoin.c -o bench_forkjoin
+ *     ./bench_forkjoin [nworkers]
+ *
+ * Each kernel is run with one worker and with nworkers workers (default: the
+ * number of online CPUs) and the result is checked against a serial run.
+ */
+#define _DEFAULT_SOURCE
+#include "aadeque_forkjoin.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* fib */
+
+#define FIB_N      36
+#define FIB_CUTOFF 12
+
+struct fib_task {
+	struct aadeque_fj_task task;
+	int n;
+	long result;
+};
+
+static long fib_serial(int n) {
+	return n < 2 ? n : fib_serial(n - 1) + fib_serial(n - 2);
+}
+
+static void fib(struct aadeque_fj_task *t, struct aadeque_fj_worker *w) {
+	struct fib_task *f = (struct fib_task *)t;
+	struct fib_task a, b;
+	if (f->n < FIB_CUTOFF) {
+		f->result = fib_serial(f->n);
+		return;
+	}
+	a.n = f->n - 1;
+	b.n = f->n - 2;
+	aadeque_fj_fork(w, &a.task, fib);
+	fib(&b.task, w);
+	aadeque_fj_join(w, &a.task);
+	f->result = a.result + b.result;
+}
+
+static double bench_fib(aadeque_fj_pool_t *p, int *ok) {
+	struct fib_task f;
+	double t0 = now();
+	f.n = FIB_N;
+	aadeque_fj_run(p, &f.task, fib);
+	t0 = now() - t0;
+	*ok = f.result == fib_serial(FIB_N);
+	return t0;
+}
+
+/* parallel quicksort */
+
+#define SORT_N      (1 << 23)
+#define SORT_CUTOFF 4096
+
+struct sort_task {
+	struct aadeque_fj_task task;
+	int *a;
+	size_t n;
+};
+
+static void sort_serial(int *a, size_t n) {
+	while (n > 16) {
+		int pivot = a[n / 2], tmp;
+		size_t i = 0, j = n - 1;
+		for (;;) {
+			while (a[i] < pivot) i++;
+			while (a[j] > pivot) j--;
+			if (i >= j) break;
+			tmp = a[i]; a[i] = a[j]; a[j] = tmp;
+			i++; j--;
+		}
+		sort_serial(a, j + 1);
+		a += j + 1;
+		n -= j + 1;
+	}
+	/* insertion sort */
+	{
+		size_t i, j;
+		for (i = 1; i < n; i++) {
+			int x = a[i];
+			for (j = i; j > 0 && a[j - 1] > x; j--)
+				a[j] = a[j - 1];
+			a[j] = x;
+		}
+	}
+}
+
+static void sort(struct aadeque_fj_task *t, struct aadeque_fj_worker *w) {
+	struct sort_task *s = (struct sort_task *)t;
+	struct sort_task left, right;
+	int *a = s->a, pivot, tmp;
+	size_t i = 0, j = s->n - 1;
+	if (s->n < SORT_CUTOFF) {
+		sort_serial(s->a, s->n);
+		return;
+	}
+	pivot = a[s->n / 2];
+	for (;;) {
+		while (a[i] < pivot) i++;
+		while (a[j] > pivot) j--;
+		if (i >= j) break;
+		tmp = a[i]; a[i] = a[j]; a[j] = tmp;
+		i++; j--;
+	}
+	left.a = a;
+	left.n = j + 1;
+	right.a = a + j + 1;
+	right.n = s->n - j - 1;
+	aadeque_fj_fork(w, &left.task, sort);
+	sort(&right.task, w);
+	aadeque_fj_join(w, &left.task);
+}
+
+static double bench_sort(aadeque_fj_pool_t *p, int *ok) {
+	struct sort_task s;
+	int *a = malloc(sizeof(int) * SORT_N);
+	uint32_t x = 2463534242u;
+	size_t i;
+	double t0;
+	for (i = 0; i < SORT_N; i++) {
+		x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+		a[i] = (int)(x >> 1);
+	}
+	s.a = a;
+	s.n = SORT_N;
+	t0 = now();
+	aadeque_fj_run(p, &s.task, sort);
+	t0 = now() - t0;
+	*ok = 1;
+	for (i = 1; i < SORT_N; i++)
+		if (a[i - 1] > a[i])
+			*ok = 0;
+	free(a);
+	return t0;
+}
+
+/* tree traversal */
+
+#define TREE_DEPTH  22
+#define TREE_CUTOFF 10
+
+struct node {
+	struct node *left, *right;
+	long value;
+};
+
+struct tree_task {
+	struct aadeque_fj_task task;
+	struct node *node;
+	int depth;
+	long sum;
+};
+
+static struct node *tree_build(int depth, long *next) {
+	struct node *n = malloc(sizeof(struct node));
+	n->value = (*next)++;
+	n->left = depth > 0 ? tree_build(depth - 1, next) : NULL;
+	n->right = depth > 0 ? tree_build(depth - 1, next) : NULL;
+	return n;
+}
+
+static void tree_free(struct node *n) {
+	if (n) {
+		tree_free(n->left);
+		tree_free(n->right);
+		free(n);
+	}
+}
+
+static long tree_sum_serial(struct node *n) {
+	return n ? n->value + tree_sum_serial(n->left) +
+	           tree_sum_serial(n->right) : 0;
+}
+
+static void tree_sum(struct aadeque_fj_task *t, struct aadeque_fj_worker *w) {
+	struct tree_task *s = (struct tree_task *)t;
+	struct tree_task left, right;
+	if (s->depth < TREE_CUTOFF || !s->node->left) {
+		s->sum = tree_sum_serial(s->node);
+		return;
+	}
+	left.node = s->node->left;
+	left.depth = s->depth - 1;
+	right.node = s->node->right;
+	right.depth = s->depth - 1;
+	aadeque_fj_fork(w, &left.task, tree_sum);
+	tree_sum(&right.task, w);
+	aadeque_fj_join(w, &left.task);
+	s->sum = s->node->value + left.sum + right.sum;
+}
+
+static struct node *tree;
+static long tree_nodes;
+
+static double bench_tree(aadeque_fj_pool_t *p, int *ok) {
+	struct tree_task s;
+	double t0;
+	s.node = tree;
+	s.depth = TREE_DEPTH;
+	t0 = now();
+	aadeque_fj_run(p, &s.task, tree_sum);
+	t0 = now() - t0;
+	/* the values are 0 to tree_nodes - 1 */
+	*ok = s.sum == tree_nodes * (tree_nodes - 1) / 2;
+	return t0;
+}
+
+static void run(const char *name, double (*bench)(aadeque_fj_pool_t *, int *),
+                aadeque_fj_pool_t *p1, aadeque_fj_pool_t *pn,
+                unsigned nworkers) {
+	int ok1, okn;
+	double t1 = bench(p1, &ok1);
+	double tn = bench(pn, &okn);
+	printf("%-8s 1 worker %8.3f s  %3u workers %8.3f s  %5.2fx  %s\n",
+	       name, t1, nworkers, tn, t1 / tn, ok1 && okn ? "ok" : "WRONG");
+}
+
+int main(int argc, char **argv) {
+	unsigned nworkers = argc > 1 ? (unsigned)atoi(argv[1])
+	                             : (unsigned)sysconf(_SC_NPROCESSORS_ONLN);
+	aadeque_fj_pool_t *p1, *pn;
+	if (nworkers < 1)
+		nworkers = 1;
+	p1 = aadeque_fj_create(1);
+	pn = aadeque_fj_create(nworkers);
+	run("fib", bench_fib, p1, pn, nworkers);
+	run("qsort", bench_sort, p1, pn, nworkers);
+	tree = tree_build(TREE_DEPTH, &tree_nodes);
+	run("tree", bench_tree, p1, pn, nworkers);
+	tree_free(tree);
+	aadeque_fj_destroy(p1);
+	aadeque_fj_destroy(pn);
+	return 0;
+}
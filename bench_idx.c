@@ -0,0 +1,99 @@
+/*
+ * Benchmark of the index computation in aadeque.h
+ *
+ * Compile and run:
+ *
+ *     gcc -O2 -std=c99 bench_idx.c -o bench_idx
+ *     ./bench_idx [n]
+ *
+ * Random aadeque_get and aadeque_set on an array deque of n ints (default:
+ * 1000003), wrapped in the middle of its buffer, so whether an index wraps is
+ * unpredictable. The three ways to compute the index in the buffer are
+ * compared, by including aadeque.h three times with different prefixes:
+ *
+ *   cond     the default conditional subtraction
+ *   bfree    AADEQUE_BRANCHFREE_IDX, a subtraction using a mask
+ *   pow2     AADEQUE_POW2_CAPACITY, power-of-2 capacities and a bitwise and
+ */
+#define _POSIX_C_SOURCE 199309L
+#define AADEQUE_VALUE_T int
+
+#define AADEQUE_PREFIX cond
+#include "aadeque.h"
+
+#undef AADEQUE_PREFIX
+#define AADEQUE_PREFIX bfree
+#define AADEQUE_BRANCHFREE_IDX
+#include "aadeque.h"
+#undef AADEQUE_BRANCHFREE_IDX
+
+#undef AADEQUE_PREFIX
+#define AADEQUE_PREFIX pow2
+#define AADEQUE_POW2_CAPACITY
+#include "aadeque.h"
+#undef AADEQUE_POW2_CAPACITY
+
+#include <stdio.h>
+#include <time.h>
+
+#define NOPS (1 << 24)
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* xorshift, for a reproducible pseudo-random sequence */
+static unsigned rng = 2463534242u;
+static unsigned next_random(void) {
+	rng ^= rng << 13;
+	rng ^= rng >> 17;
+	rng ^= rng << 5;
+	return rng;
+}
+
+static unsigned *indices;
+
+/*
+ * Defines a function that creates an array deque of n elements, rotates it
+ * by half its length so it wraps, and times NOPS random gets and sets.
+ */
+#define BENCH(prefix)                                                         \
+static void bench_##prefix(unsigned n) {                                      \
+	prefix##_t *a = prefix##_create(n);                                       \
+	double t_get, t_set;                                                      \
+	unsigned i;                                                               \
+	long sum = 0;                                                             \
+	for (i = 0; i < n; i++)                                                   \
+		prefix##_set(a, i, (int)i);                                           \
+	for (i = 0; i < n / 2; i++)                                               \
+		prefix##_push(&a, prefix##_shift(&a));                                \
+	t_get = now();                                                            \
+	for (i = 0; i < NOPS; i++)                                                \
+		sum += prefix##_get(a, indices[i]);                                   \
+	t_get = now() - t_get;                                                    \
+	t_set = now();                                                            \
+	for (i = 0; i < NOPS; i++)                                                \
+		prefix##_set(a, indices[i], (int)i);                                  \
+	t_set = now() - t_set;                                                    \
+	printf("%-6s cap %8u  get %6.2f ns  set %6.2f ns  (sum %ld)\n",           \
+	       #prefix, a->cap, t_get / NOPS * 1e9, t_set / NOPS * 1e9, sum);     \
+	prefix##_destroy(a);                                                      \
+}
+
+BENCH(cond)
+BENCH(bfree)
+BENCH(pow2)
+
+int main(int argc, char **argv) {
+	unsigned n = argc > 1 ? (unsigned)atoi(argv[1]) : 1000003, i;
+	indices = malloc(sizeof(unsigned) * NOPS);
+	for (i = 0; i < NOPS; i++)
+		indices[i] = next_random() % n;
+	bench_cond(n);
+	bench_bfree(n);
+	bench_pow2(n);
+	free(indices);
+	return 0;
+}
@@ -0,0 +1,96 @@
+/*
+ * Benchmark for aadeque_multi.h
+ *
+ * Compile and run:
+ *
+ *     gcc -O2 -std=c99 bench_multi.c -o bench_multi
+ *     ./bench_multi [ndeques]
+ *
+ * Values are pushed to ndeques array deques (default: 1 << 18) in batches of
+ * BATCH entries for randomly chosen deques, like packets to per-flow queues,
+ * and then shifted from the same deques. A plain loop of aadeque_push and
+ * aadeque_shift is compared with aadeque_push_many and aadeque_shift_many.
+ */
+#define _POSIX_C_SOURCE 199309L
+#define AADEQUE_VALUE_T unsigned
+#include "aadeque.h"
+#include "aadeque_multi.h"
+
+#include <stdio.h>
+#include <time.h>
+
+#define BATCH  256
+#define ROUNDS 20000
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* xorshift, for a reproducible pseudo-random sequence */
+static unsigned rng = 2463534242u;
+static unsigned next_random(void) {
+	rng ^= rng << 13;
+	rng ^= rng >> 17;
+	rng ^= rng << 5;
+	return rng;
+}
+
+static aadeque_t **deques;
+
+static double bench(unsigned ndeques, int batched, unsigned long *sum) {
+	struct aadeque_op ops[BATCH], out[BATCH];
+	aadeque_t **aptrs[BATCH];
+	double t0 = 0, t;
+	int r, i;
+	rng = 2463534242u;
+	*sum = 0;
+	for (r = 0; r < ROUNDS; r++) {
+		size_t n;
+		for (i = 0; i < BATCH; i++) {
+			ops[i].aptr = &deques[next_random() % ndeques];
+			ops[i].value = r + i;
+			aptrs[i] = ops[i].aptr;
+		}
+		t = now();
+		if (batched) {
+			aadeque_push_many(ops, BATCH);
+			n = aadeque_shift_many(aptrs, BATCH, out);
+		}
+		else {
+			for (i = 0; i < BATCH; i++)
+				aadeque_push(ops[i].aptr, ops[i].value);
+			for (i = 0, n = 0; i < BATCH; i++) {
+				if ((*aptrs[i])->len == 0)
+					continue;
+				out[n].aptr = aptrs[i];
+				out[n].value = aadeque_shift(aptrs[i]);
+				n++;
+			}
+		}
+		t0 += now() - t;
+		for (i = 0; i < (int)n; i++)
+			*sum += out[i].value;
+	}
+	return t0;
+}
+
+int main(int argc, char **argv) {
+	unsigned ndeques = argc > 1 ? (unsigned)atoi(argv[1]) : 1u << 18, i;
+	unsigned long sum1, sum2;
+	double t1, t2;
+	deques = malloc(sizeof(aadeque_t *) * ndeques);
+	for (i = 0; i < ndeques; i++)
+		deques[i] = aadeque_create_empty();
+	t1 = bench(ndeques, 0, &sum1);
+	t2 = bench(ndeques, 1, &sum2);
+	printf("%u deques, %d batches of %d\n", ndeques, ROUNDS, BATCH);
+	printf("loop     %8.3f s\n", t1);
+	printf("batched  %8.3f s  %5.2fx  %s\n", t2, t1 / t2,
+	       sum1 == sum2 ? "ok" : "MISMATCH");
+	for (i = 0; i < ndeques; i++)
+		aadeque_destroy(deques[i]);
+	free(deques);
+	return 0;
+}
@@ -0,0 +1,106 @@
+/*
+ * Benchmark for the prefetching iteration functions in aadeque.h
+ *
+ * Compile and run:
+ *
+ *     gcc -O2 -std=c99 bench_prefetch.c -o bench_prefetch
+ *     ./bench_prefetch [n]
+ *
+ * An array deque of n pointers (default: 1 << 21) to nodes in random order in
+ * memory, wrapped around the end of its buffer, is iterated over and the
+ * values in the nodes are summed, after some work on each. A loop of
+ * aadeque_get is compared with aadeque_each and aadeque_each_pointee.
+ */
+#define _POSIX_C_SOURCE 199309L
+#define AADEQUE_PREFETCH_POINTEE
+#define AADEQUE_VALUE_T struct node *
+struct node;
+#include "aadeque.h"
+
+#include <stdio.h>
+#include <time.h>
+
+/* a node, the size of a cache line */
+struct node {
+	unsigned long value;
+	char pad[56];
+};
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* xorshift, for a reproducible pseudo-random sequence */
+static unsigned rng = 2463534242u;
+static unsigned next_random(void) {
+	rng ^= rng << 13;
+	rng ^= rng >> 17;
+	rng ^= rng << 5;
+	return rng;
+}
+
+/* Some work per node, which fills the out-of-order window of the CPU. */
+#define WORK 40
+
+static unsigned long work(struct node *x) {
+	unsigned long h = x->value;
+	int k;
+	for (k = 0; k < WORK; k++)
+		h = h * 31 + k;
+	return h;
+}
+
+static void add(struct node *x, void *ctx) {
+	*(unsigned long *)ctx += work(x);
+}
+
+int main(int argc, char **argv) {
+	unsigned n = argc > 1 ? (unsigned)atoi(argv[1]) : 1u << 21, i;
+	struct node *nodes = malloc(sizeof(struct node) * n);
+	struct node **order = malloc(sizeof(struct node *) * n);
+	aadeque_t *a = aadeque_create_empty();
+	unsigned long sum_get = 0, sum_each = 0, sum_pointee = 0;
+	double t_get, t_each, t_pointee;
+	/* a random permutation of the nodes */
+	for (i = 0; i < n; i++) {
+		nodes[i].value = i;
+		order[i] = &nodes[i];
+	}
+	for (i = n - 1; i > 0; i--) {
+		unsigned j = next_random() % (i + 1);
+		struct node *tmp = order[i];
+		order[i] = order[j];
+		order[j] = tmp;
+	}
+	/* half of them pushed and half unshifted, so it's wrapped */
+	for (i = n / 2; i < n; i++)
+		aadeque_push(&a, order[i]);
+	for (i = n / 2; i > 0; i--)
+		aadeque_unshift(&a, order[i - 1]);
+
+	t_get = now();
+	for (i = 0; i < aadeque_len(a); i++)
+		sum_get += work(aadeque_get(a, i));
+	t_get = now() - t_get;
+
+	t_each = now();
+	aadeque_each(a, 0, aadeque_len(a), add, &sum_each);
+	t_each = now() - t_each;
+
+	t_pointee = now();
+	aadeque_each_pointee(a, 0, aadeque_len(a), add, &sum_pointee);
+	t_pointee = now() - t_pointee;
+
+	printf("%u pointers to nodes in random order\n", n);
+	printf("get loop      %8.3f s\n", t_get);
+	printf("each          %8.3f s  %5.2fx  %s\n", t_each, t_get / t_each,
+	       sum_each == sum_get ? "ok" : "MISMATCH");
+	printf("each_pointee  %8.3f s  %5.2fx  %s\n", t_pointee,
+	       t_get / t_pointee, sum_pointee == sum_get ? "ok" : "MISMATCH");
+	aadeque_destroy(a);
+	free(order);
+	free(nodes);
+	return 0;
+}
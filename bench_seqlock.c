@@ -0,0 +1,141 @@
+/*
+ * Benchmark for aadeque_seqlock.h
+ *
+ * Compile and run:
+ *
+ *     gcc -O2 -std=c11 -pthread bench_seqlock.c -o bench_seqlock
+ *     ./bench_seqlock [nreaders]
+ *
+ * One writer pushes samples to a ring of the last 1024 samples while nreaders
+ * readers (default: the number of online CPUs minus one, at least one)
+ * repeatedly copy out the last 64 samples, for one second. The seqlock ring is
+ * compared with an array deque protected by a mutex.
+ */
+#define _DEFAULT_SOURCE
+#define AADEQUE_VALUE_T double
+#include "aadeque.h"
+#include "aadeque_seqlock.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RING_CAP   1024
+#define WINDOW     64
+#define DURATION   1.0
+#define MAX_READERS 64
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static atomic_int stop;
+
+/* mutex */
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static aadeque_t *locked;
+
+static void *mutex_reader(void *arg) {
+	double buf[WINDOW];
+	unsigned long reads = 0;
+	while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+		AADEQUE_SIZE_T k;
+		pthread_mutex_lock(&lock);
+		k = locked->len < WINDOW ? locked->len : WINDOW;
+		aadeque_copy_out(locked, locked->len - k, k, buf);
+		pthread_mutex_unlock(&lock);
+		reads++;
+	}
+	/* Counted locally, to not share cache lines with other readers. */
+	*(unsigned long *)arg = reads;
+	return NULL;
+}
+
+static unsigned long mutex_writer(void) {
+	unsigned long writes = 0;
+	while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+		pthread_mutex_lock(&lock);
+		if (locked->len == RING_CAP)
+			aadeque_shift(&locked);
+		aadeque_push(&locked, (double)writes);
+		pthread_mutex_unlock(&lock);
+		writes++;
+	}
+	return writes;
+}
+
+/* seqlock */
+
+static struct aadeque_seqring *ring;
+
+static void *seqlock_reader(void *arg) {
+	double buf[WINDOW];
+	unsigned long reads = 0;
+	while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+		aadeque_seqring_read_last(ring, buf, WINDOW);
+		reads++;
+	}
+	*(unsigned long *)arg = reads;
+	return NULL;
+}
+
+static unsigned long seqlock_writer(void) {
+	unsigned long writes = 0;
+	while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+		aadeque_seqring_push(ring, (double)writes);
+		writes++;
+	}
+	return writes;
+}
+
+/* Stops the benchmark after DURATION seconds. */
+static void *timer(void *arg) {
+	double t0 = now();
+	(void)arg;
+	while (now() - t0 < DURATION)
+		usleep(1000);
+	atomic_store(&stop, 1);
+	return NULL;
+}
+
+static void run(const char *name, void *(*reader)(void *),
+                unsigned long (*writer)(void), int nreaders) {
+	pthread_t readers[MAX_READERS], t;
+	unsigned long reads[MAX_READERS] = {0}, writes, total = 0;
+	double t0;
+	int i;
+	atomic_store(&stop, 0);
+	for (i = 0; i < nreaders; i++)
+		pthread_create(&readers[i], NULL, reader, &reads[i]);
+	pthread_create(&t, NULL, timer, NULL);
+	t0 = now();
+	writes = writer();
+	t0 = now() - t0;
+	pthread_join(t, NULL);
+	for (i = 0; i < nreaders; i++) {
+		pthread_join(readers[i], NULL);
+		total += reads[i];
+	}
+	printf("%-8s %2d readers  %8.2f M writes/s  %8.2f M reads/s\n",
+	       name, nreaders, writes / t0 * 1e-6, total / t0 * 1e-6);
+}
+
+int main(int argc, char **argv) {
+	int nreaders = argc > 1 ? atoi(argv[1])
+	                        : (int)sysconf(_SC_NPROCESSORS_ONLN) - 1;
+	if (nreaders < 1)
+		nreaders = 1;
+	if (nreaders > MAX_READERS)
+		nreaders = MAX_READERS;
+	locked = aadeque_create_empty();
+	run("mutex", mutex_reader, mutex_writer, nreaders);
+	aadeque_destroy(locked);
+	ring = aadeque_seqring_create(RING_CAP);
+	run("seqlock", seqlock_reader, seqlock_writer, nreaders);
+	aadeque_seqring_destroy(ring);
+	return 0;
+}
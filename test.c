@@ -2,6 +2,7 @@
  * Tests for aadeque.h
  */
 #include <stdlib.h>
+#include <stddef.h>
 
 /* defining tweaking macros, before including aadeque.h */
 #define AADEQUE_VALUE_T int
@@ -33,6 +34,68 @@ void test_free(void *ptr, size_t size) {
 }
 
 
+#include "aadeque.h"
+#include "aadeque_multi.h"
+#include "aadeque_hash.h"
+#include "aadeque_bucketq.h"
+
+/* a deque with the arithmetic kernels and scans */
+#undef AADEQUE_PREFIX
+#define AADEQUE_PREFIX ar
+#define AADEQUE_ARITHMETIC
+#include "aadeque.h"
+
+/* a deque with handles */
+#undef AADEQUE_PREFIX
+#undef AADEQUE_ARITHMETIC
+#define AADEQUE_PREFIX hd
+#define AADEQUE_HANDLES
+#include "aadeque.h"
+
+/* these instantiate aadeque.h too, while the macros for hd are defined */
+#include "aadeque_bits.h"
+#include "aadeque_delta.h"
+#include "aadeque_records.h"
+#include "aadeque_quantile.h"
+#include "aadeque_timerwheel.h"
+
+/* the headers above restore the macros they use for their own instantiations */
+#if defined(AADEQUE_PREFIX) && defined(AADEQUE_VALUE_T) && \
+    defined(AADEQUE_HANDLES) && !defined(AADEQUE_HEADER)
+static const int config_kept = 1;
+#else
+static const int config_kept = 0;
+#endif
+
+/* a deque of bytes, for the functions for byte deques */
+#undef AADEQUE_PREFIX
+#undef AADEQUE_VALUE_T
+#undef AADEQUE_HANDLES
+#define AADEQUE_PREFIX bytes
+#define AADEQUE_VALUE_T unsigned char
+#define AADEQUE_MEMCMP
+#include "aadeque.h"
+#include "aadeque_frames.h"
+#include "aadeque_hash.h"
+
+/* a deque of pointers, for aadeque_each_pointee */
+#undef AADEQUE_PREFIX
+#undef AADEQUE_VALUE_T
+#undef AADEQUE_MEMCMP
+#define AADEQUE_PREFIX ptrs
+#define AADEQUE_VALUE_T int *
+#define AADEQUE_PREFETCH_POINTEE
+#include "aadeque.h"
+
+/* a deque with power-of-2 capacities, for the masking aadeque_idx */
+#undef AADEQUE_PREFIX
+#undef AADEQUE_VALUE_T
+#undef AADEQUE_PREFETCH_POINTEE
+#undef AADEQUE_MIN_CAPACITY
+#define AADEQUE_PREFIX pow2
+#define AADEQUE_VALUE_T int
+#define AADEQUE_MIN_CAPACITY 4
+#define AADEQUE_POW2_CAPACITY
 #include "aadeque.h"
 
 #include <stdio.h>
@@ -164,6 +227,18 @@ void test_delete_first_n(void) {
 	aadeque_destroy(a);
 }
 
+void test_delete_all(void) {
+	int before[5] = {1, 2, 3, 4, 5};
+	aadeque_t *a = aadeque_from_array(before, 5);
+	AADEQUE_SIZE_T cap = a->cap;
+	aadeque_delete_all(a);
+	test(a->len == 0 && a->cap == cap, "aadeque_delete_all");
+	aadeque_push(&a, 6);
+	test(a->len == 1 && aadeque_get(a, 0) == 6 && a->cap == cap,
+	     "aadeque_delete_all: reuse");
+	aadeque_destroy(a);
+}
+
 void test_slice(void) {
 	int before[7] = {1, 2, 3, 4, 5, 6, 7},
 	    after [4] = {3, 4, 5, 6};
@@ -174,12 +249,174 @@ void test_slice(void) {
 	aadeque_destroy(b);
 }
 
+void test_fill_copy_out(void) {
+	int init    [5] = {3, 4, 5, 6, 7},
+	    filled  [7] = {1, 2, 0, 0, 0, 6, 7},
+	    expected[4] = {2, 0, 0, 0};
+	int out[4], *array;
+	aadeque_t *a = aadeque_from_array(init, 5);
+	aadeque_unshift(&a, 2);
+	aadeque_unshift(&a, 1);
+	test(a->off + a->len > a->cap, "aadeque_fill: setup");
+	aadeque_fill(a, 2, 3, 0);
+	test(aadeque_eq_array(a, filled, 7), "aadeque_fill");
+	aadeque_copy_out(a, 1, 4, out);
+	test(memcmp(out, expected, sizeof(out)) == 0, "aadeque_copy_out");
+	array = aadeque_to_array(a);
+	test(memcmp(array, filled, sizeof(filled)) == 0, "aadeque_to_array");
+	AADEQUE_FREE(array, sizeof(int) * 7);
+	aadeque_destroy(a);
+}
+
+static int square_plus(int x, void *ctx) {
+	return x * x + *(int *)ctx;
+}
+
+void test_reverse_transform(void) {
+	int init    [5] = {3, 4, 5, 6, 7},
+	    reversed[7] = {7, 6, 5, 4, 3, 2, 1},
+	    squared [7] = {50, 37, 26, 17, 10, 5, 2};
+	int one = 1;
+	aadeque_t *a = aadeque_from_array(init, 5);
+	aadeque_unshift(&a, 2);
+	aadeque_unshift(&a, 1);
+	test(a->off + a->len > a->cap, "aadeque_reverse: setup");
+	aadeque_reverse(a);
+	test(aadeque_eq_array(a, reversed, 7), "aadeque_reverse: odd length");
+	aadeque_push(&a, 0);
+	aadeque_reverse(a);
+	aadeque_shift(&a);
+	aadeque_reverse(a);
+	test(aadeque_eq_array(a, reversed, 7), "aadeque_reverse: even length");
+	aadeque_transform(a, square_plus, &one);
+	test(aadeque_eq_array(a, squared, 7), "aadeque_transform");
+	aadeque_destroy(a);
+}
+
+void test_arithmetic(void) {
+	int init   [5] = {26, 17, 10, 5, 2},
+	    clamped[7] = {15, 15, 15, 15, 11, 5, 5};
+	ar_t *a = ar_from_array(init, 5);
+	ar_unshift(&a, 37);
+	ar_unshift(&a, 50);
+	test(a->off + a->len > a->cap, "aadeque_add: setup");
+	ar_scale(a, 2);
+	ar_add(a, -9);
+	ar_clamp(a, 5, 15);
+	test(ar_eq_array(a, clamped, 7),
+	     "aadeque_add, aadeque_scale, aadeque_clamp");
+	ar_destroy(a);
+}
+
+struct each_ctx {
+	int n;
+	int ok;
+};
+
+static void each_check(int x, void *ctx) {
+	struct each_ctx *c = (struct each_ctx *)ctx;
+	if (x != c->n++)
+		c->ok = 0;
+}
+
+static void each_check_pointee(int *x, void *ctx) {
+	each_check(*x, ctx);
+}
+
+void test_each(void) {
+	struct each_ctx c = {0, 1};
+	aadeque_t *a = aadeque_create_empty();
+	ptrs_t *p = ptrs_create_empty();
+	int i, values[100];
+	/* wrapped, with a part of 100 - 30 elements and a part of 30 */
+	for (i = 30; i < 100; i++)
+		aadeque_push(&a, i);
+	for (i = 29; i >= 0; i--)
+		aadeque_unshift(&a, i);
+	test(a->off + a->len > a->cap, "aadeque_each: setup");
+	aadeque_each(a, 0, 100, each_check, &c);
+	test(c.ok && c.n == 100, "aadeque_each: all in order across the wrap");
+	c.n = 5;
+	aadeque_each(a, 5, 3, each_check, &c);
+	test(c.ok && c.n == 8, "aadeque_each: range");
+	for (i = 0; i < 100; i++) {
+		values[i] = i;
+		ptrs_unshift(&p, &values[99 - i]);
+	}
+	c.n = 0;
+	ptrs_each_pointee(p, 0, 100, each_check_pointee, &c);
+	test(c.ok && c.n == 100, "aadeque_each_pointee");
+	aadeque_destroy(a);
+	ptrs_destroy(p);
+}
+
+void test_scan(void) {
+	int init     [5] = {3, 4, 5, 6, 7},
+	    inclusive[7] = {1, 3, 6, 10, 15, 21, 28},
+	    exclusive[7] = {0, 1, 3, 6, 10, 15, 21};
+	int out[7];
+	ar_t *a = ar_from_array(init, 5);
+	ar_unshift(&a, 2);
+	ar_unshift(&a, 1);
+	test(ar_inclusive_scan_to(a, out) == 28 &&
+	     memcmp(out, inclusive, sizeof(out)) == 0, "aadeque_inclusive_scan_to");
+	test(ar_exclusive_scan_to(a, out) == 28 &&
+	     memcmp(out, exclusive, sizeof(out)) == 0, "aadeque_exclusive_scan_to");
+	ar_destroy(a);
+	a = ar_from_array(init, 5);
+	ar_unshift(&a, 2);
+	ar_unshift(&a, 1);
+	test(ar_inclusive_scan(a) == 28 && ar_eq_array(a, inclusive, 7),
+	     "aadeque_inclusive_scan");
+	ar_destroy(a);
+	a = ar_from_array(init, 5);
+	ar_unshift(&a, 2);
+	ar_unshift(&a, 1);
+	test(ar_exclusive_scan(a) == 28 && ar_eq_array(a, exclusive, 7),
+	     "aadeque_exclusive_scan");
+	ar_destroy(a);
+}
+
+void test_eq_cmp(void) {
+	int values[6] = {1, 2, 3, 4, 5, 6},
+	    bigger[6] = {1, 2, 3, 4, 6, 0};
+	aadeque_t *a = aadeque_from_array(values, 6),
+	          *b = aadeque_create_empty(),
+	          *c = aadeque_from_array(bigger, 6);
+	bytes_t *x = bytes_create_empty(), *y = bytes_create_empty();
+	int i;
+	/* same contents, different memory layout */
+	for (i = 5; i >= 0; i--)
+		aadeque_unshift(&b, values[i]);
+	test(aadeque_eq(a, b) && aadeque_cmp(a, b) == 0, "aadeque_eq: equal");
+	test(!aadeque_eq(a, c) && aadeque_cmp(a, c) < 0 && aadeque_cmp(c, a) > 0,
+	     "aadeque_cmp: different");
+	aadeque_pop(&b);
+	test(!aadeque_eq(a, b) && aadeque_cmp(b, a) < 0 && aadeque_cmp(a, b) > 0,
+	     "aadeque_cmp: prefix");
+	/* memcmp doesn't give the order of multi-byte values, but it does for bytes */
+	for (i = 0; i < 10; i++) {
+		bytes_unshift(&x, (unsigned char)i);
+		bytes_push(&y, (unsigned char)(9 - i));
+	}
+	test(bytes_eq(x, y) && bytes_cmp(x, y) == 0, "bytes_eq: memcmp");
+	bytes_set(y, 7, 200);
+	test(!bytes_eq(x, y) && bytes_cmp(x, y) < 0, "bytes_cmp: memcmp");
+	aadeque_destroy(a);
+	aadeque_destroy(b);
+	aadeque_destroy(c);
+	bytes_destroy(x);
+	bytes_destroy(y);
+}
+
 /*
  * Growing the memory for special case of memory layout. See the comments in the
  * source code of aadeque_reserve() in aadeque.h.
  */
 void test_grow_warping(void) {
-	int values[5] = {1, 2, 3, 4, 5};
+	int values[5] = {1, 2, 3, 4, 5},
+	    expected[13] = {12, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 13};
+	int i, ok = 1;
 	/* create an array deque with warping memory layout */
 	aadeque_t *a = aadeque_create_empty();
 	aadeque_push(&a, 4);
@@ -191,6 +428,20 @@ void test_grow_warping(void) {
 	test(a->off + a->len > a->cap, "Growing warped memory: setup");
 	test(aadeque_eq_array(a, values, 5), "Growing warped memory: contents");
 	aadeque_destroy(a);
+	/* full and warped with a first part shorter than the growth */
+	a = aadeque_create_empty();
+	for (i = 1; i <= 12; i++)
+		aadeque_push(&a, i);
+	for (i = 0; i < 11; i++)
+		aadeque_push(&a, aadeque_shift(&a));
+	test(a->cap == 12 && a->len == 12 && a->off == 11,
+	     "Growing warped memory, short first part: setup");
+	aadeque_push(&a, 13);
+	for (i = 0; i < 13; i++)
+		ok &= aadeque_get(a, i) == expected[i];
+	test(a->cap == 24 && ok,
+	     "Growing warped memory, short first part: contents");
+	aadeque_destroy(a);
 }
 
 /*
@@ -274,6 +525,437 @@ void test_shrink_case_3(void) {
 	aadeque_destroy(a);
 }
 
+void test_bits(void) {
+	aadeque_bits_t *a = aadeque_bits_create_empty();
+	int i, ok = 1;
+	uint64_t w;
+	/* 3 bits, then words that don't align with the underlying words */
+	for (i = 0; i < 3; i++)
+		aadeque_bits_push_bit(&a, i & 1);
+	aadeque_bits_push_word(&a, 0xf0f0f0f0f0f0f0f0ULL);
+	aadeque_bits_push_bits(&a, 0x5, 3);
+	test(aadeque_bits_len(a) == 70 && a->len == 2, "aadeque_bits: push");
+	test(aadeque_bits_count(a) == 1 + 32 + 2, "aadeque_bits: count");
+	for (i = 0; i < 64; i++)
+		ok &= aadeque_bits_get_bit(a, 3 + i) == (int)((0xf0f0f0f0f0f0f0f0ULL >> i) & 1);
+	test(ok, "aadeque_bits: get_bit");
+	/* unshift a bit, so that the first word is prepended */
+	aadeque_bits_unshift_bit(&a, 1);
+	test(aadeque_bits_len(a) == 71 && a->len == 3 && a->bitoff == 63,
+	     "aadeque_bits: unshift_bit");
+	ok = aadeque_bits_shift_bit(&a) == 1;
+	ok &= aadeque_bits_shift_bits(&a, 3) == 0x2;
+	w = aadeque_bits_shift_word(&a);
+	test(ok && w == 0xf0f0f0f0f0f0f0f0ULL, "aadeque_bits: shift");
+	test(aadeque_bits_pop_bit(&a) == 1 && aadeque_bits_len(a) == 2 &&
+	     aadeque_bits_count(a) == 1 && a->len == 1, "aadeque_bits: pop_bit");
+	aadeque_bits_shift_bits(&a, 2);
+	test(aadeque_bits_len(a) == 0 && a->len == 0, "aadeque_bits: empty");
+	aadeque_bits_destroy(a);
+}
+
+void test_delta(void) {
+	aadeque_delta_t *a = aadeque_delta_create_empty();
+	uint64_t i, value = 1000000000000ULL;
+	int ok = 1;
+	/* mix small and large steps, enough for several blocks */
+	for (i = 0; i < 1000; i++)
+		aadeque_delta_push(&a, value + i * i * (i % 7 == 0 ? 1000 : 1));
+	test(aadeque_delta_len(a) == 1000 && a->len > 3, "aadeque_delta: push");
+	for (i = 0; i < 1000; i++)
+		ok &= aadeque_delta_get(a, i) == value + i * i * (i % 7 == 0 ? 1000 : 1);
+	test(ok, "aadeque_delta: get");
+	/* shift past the first few blocks */
+	for (i = 0; i < 500; i++)
+		ok &= aadeque_delta_shift(&a) == value + i * i * (i % 7 == 0 ? 1000 : 1);
+	test(ok && aadeque_delta_len(a) == 500, "aadeque_delta: shift");
+	for (i = 0; i < 500; i++)
+		ok &= aadeque_delta_get(a, i) ==
+		      value + (i + 500) * (i + 500) * ((i + 500) % 7 == 0 ? 1000 : 1);
+	test(ok, "aadeque_delta: get after shift");
+	while (aadeque_delta_len(a) > 0)
+		aadeque_delta_shift(&a);
+	test(a->len == 0, "aadeque_delta: all blocks dropped");
+	aadeque_delta_push(&a, 42);
+	test(aadeque_delta_first(a) == 42, "aadeque_delta: push after empty");
+	aadeque_delta_destroy(a);
+}
+
+void test_span(void) {
+	int expected[5] = {1, 2, 3, 4, 5};
+	aadeque_t *a = aadeque_from_array(expected + 2, 3);
+	unsigned k;
+	int *p;
+	aadeque_unshift(&a, 2);
+	aadeque_unshift(&a, 1);
+	/* warped: {1, 2} at the end of the buffer, {3, 4, 5} at the beginning */
+	p = aadeque_span(a, 0, 5, &k);
+	test(k == 2 && p[0] == 1 && p[1] == 2, "aadeque_span: first part");
+	p = aadeque_span(a, 2, 3, &k);
+	test(k == 3 && p[0] == 3 && p[2] == 5, "aadeque_span: second part");
+	aadeque_destroy(a);
+}
+
+void test_handles(void) {
+	hd_t *a = hd_create_empty();
+	struct hd_handle h, first;
+	unsigned i;
+	int *p;
+	for (i = 0; i < 3; i++)
+		hd_push(&a, i);
+	first = hd_handle(&a, 0);
+	h = hd_handle(&a, 2);
+	p = hd_resolve(h);
+	test(p != NULL && *p == 2, "aadeque_resolve: element found");
+	/* grow the buffer and move the first element */
+	for (i = 3; i < 100; i++)
+		hd_push(&a, i);
+	hd_unshift(&a, -1);
+	hd_unshift(&a, -2);
+	test(hd_handle_index(h, &i) && i == 4 && *hd_resolve(h) == 2,
+	     "aadeque_resolve: after reallocation and unshift");
+	*hd_resolve(h) = 42;
+	test(hd_get(a, 4) == 42, "aadeque_resolve: modify element");
+	/* shrink the buffer */
+	a = hd_delete_first_n(a, 4);
+	a = hd_delete_last_n(a, 90);
+	test(hd_resolve(first) == NULL && *hd_resolve(h) == 42,
+	     "aadeque_resolve: after compaction");
+	hd_delete_all(a);
+	hd_push(&a, 7);
+	test(hd_resolve(h) == NULL, "aadeque_resolve: deleted element");
+	hd_destroy(a);
+}
+
+void test_multi(void) {
+	aadeque_t *a[4];
+	aadeque_t **aptrs[4];
+	struct aadeque_op ops[40];
+	int i, ok = 1;
+	size_t n;
+	for (i = 0; i < 4; i++) {
+		a[i] = aadeque_create_empty();
+		aptrs[i] = &a[i];
+	}
+	/* 40 values to deques 0, 1 and 2, so they are reallocated */
+	for (i = 0; i < 40; i++) {
+		ops[i].aptr = &a[i % 3];
+		ops[i].value = i;
+	}
+	aadeque_push_many(ops, 40);
+	for (i = 0; i < 40; i++)
+		if (aadeque_get(a[i % 3], i / 3) != i)
+			ok = 0;
+	test(ok && a[0]->len == 14 && a[2]->len == 13 && a[3]->len == 0,
+	     "aadeque_push_many: values pushed in order");
+	n = aadeque_shift_many(aptrs, 4, ops);
+	test(n == 3 && ops[0].aptr == &a[0] && ops[0].value == 0 &&
+	     ops[2].aptr == &a[2] && ops[2].value == 2 && a[0]->len == 13,
+	     "aadeque_shift_many: empty deque skipped");
+	for (i = 0; i < 4; i++)
+		aadeque_destroy(a[i]);
+}
+
+void test_pow2(void) {
+	pow2_t *a = pow2_create(5);
+	int i, ok = 1;
+	test(a->cap == 8, "AADEQUE_POW2_CAPACITY: create rounds up");
+	pow2_delete_all(a);
+	for (i = 0; i < 20; i++)
+		pow2_push(&a, i);
+	for (i = -1; i >= -20; i--)
+		pow2_unshift(&a, i);
+	for (i = 0; i < 40; i++)
+		if (pow2_get(a, i) != i - 20)
+			ok = 0;
+	test(ok && a->cap == 64 && a->off + a->len > a->cap,
+	     "AADEQUE_POW2_CAPACITY: get when wrapped");
+	a = pow2_delete_first_n(a, 30);
+	test(a->cap == 32 && pow2_get(a, 0) == 10 && pow2_get(a, 9) == 19,
+	     "AADEQUE_POW2_CAPACITY: get after compaction");
+	pow2_destroy(a);
+}
+
+void test_records(void) {
+	aadeque_records_t *a = aadeque_records_create_empty();
+	struct aadeque_records_view view;
+	char buf[32];
+	int i, ok = 1;
+	aadeque_records_push(&a, "hello", 5);
+	aadeque_records_push(&a, "", 0);
+	aadeque_records_push(&a, "world!", 6);
+	test(aadeque_records_count(a) == 3 && aadeque_records_len(a, 1) == 0 &&
+	     aadeque_records_len(a, 2) == 6, "aadeque_records: push");
+	test(aadeque_records_shift(&a, buf) == 5 && memcmp(buf, "hello", 5) == 0,
+	     "aadeque_records: shift");
+	/* push and shift until the payload wraps around the end of the buffer */
+	for (i = 0; i < 20; i++) {
+		sprintf(buf, "record %d", i);
+		aadeque_records_push(&a, buf, strlen(buf));
+		if (i % 3 == 0)
+			aadeque_records_shift(&a, NULL);
+	}
+	test(a->off + a->len > a->cap, "aadeque_records: setup wrapped payload");
+	for (i = 0; i < (int)aadeque_records_count(a); i++) {
+		char expect[32];
+		unsigned n = aadeque_records_peek(a, i, &view);
+		sprintf(expect, "record %d", i + 5);
+		memcpy(buf, view.p[0], view.n[0]);
+		memcpy(buf + view.n[0], view.p[1], view.n[1]);
+		ok &= n == strlen(expect) && memcmp(buf, expect, n) == 0;
+	}
+	test(ok, "aadeque_records: peek");
+	aadeque_records_destroy(a);
+}
+
+void test_frames(void) {
+	static const int lenbytes[5] = {1, 2, 4, 8, AADEQUE_FRAME_VARINT};
+	bytes_t *a = bytes_create_empty();
+	struct bytes_frame frame;
+	unsigned pos;
+	char buf[300];
+	int i, j, ok = 1;
+	memset(buf, 'x', sizeof(buf));
+	for (i = 0; i < 5; i++) {
+		/* make the buffer wrap */
+		a = bytes_make_space_after(a, 7);
+		a = bytes_delete_first_n(a, 7);
+		bytes_frame_push(&a, lenbytes[i], "abc", 3);
+		bytes_frame_push(&a, lenbytes[i], buf, i < 1 ? 255 : 300);
+		bytes_frame_push(&a, lenbytes[i], "", 0);
+		bytes_frame_push(&a, lenbytes[i], "xyz", 3);
+		/* leave the last frame incomplete */
+		a = bytes_delete_last_n(a, 1);
+		pos = 0;
+		j = 0;
+		while (bytes_frame_next(a, &pos, lenbytes[i], &frame) == 1) {
+			switch (j++) {
+			case 0:
+				ok &= frame.len == 3 && frame.n[0] + frame.n[1] == 3 &&
+				      frame.p[0][0] == 'a';
+				break;
+			case 1:
+				ok &= frame.len == (i < 1 ? 255 : 300) &&
+				      frame.n[0] + frame.n[1] == frame.len;
+				break;
+			case 2:
+				ok &= frame.len == 0;
+				break;
+			}
+		}
+		ok &= j == 3 && frame.len == 3;
+		a = bytes_delete_first_n(a, pos);
+		ok &= bytes_len(a) ==
+		      (unsigned)(2 + (lenbytes[i] ? lenbytes[i] : 1));
+		a = bytes_delete_first_n(a, bytes_len(a));
+	}
+	test(ok, "bytes_frame_push, bytes_frame_next");
+	/* a varint that never ends */
+	a = bytes_make_space_after(a, 11);
+	memset(a->els, 0xff, a->cap);
+	pos = 0;
+	test(bytes_frame_next(a, &pos, AADEQUE_FRAME_VARINT, &frame) == -1,
+	     "bytes_frame_next: malformed varint");
+	/* a 10 byte varint with more than 64 bits */
+	bytes_set(a, 9, 0x02);
+	test(bytes_frame_next(a, &pos, AADEQUE_FRAME_VARINT, &frame) == -1,
+	     "bytes_frame_next: varint overflowing 64 bits");
+	/* lengths of 2^32, which don't fit in the unsigned int AADEQUE_SIZE_T */
+	bytes_fill(a, 0, bytes_len(a), 0);
+	bytes_set(a, 3, 1);
+	test(bytes_frame_next(a, &pos, 8, &frame) == -1 && pos == 0,
+	     "bytes_frame_next: 8 byte length too large");
+	bytes_fill(a, 0, 4, 0x80);
+	bytes_set(a, 4, 0x10);
+	test(bytes_frame_next(a, &pos, AADEQUE_FRAME_VARINT, &frame) == -1,
+	     "bytes_frame_next: varint length too large");
+	bytes_destroy(a);
+}
+
+void test_hash(void) {
+	int values[40], i;
+	struct aadeque_xxh64 s;
+	aadeque_t *a = aadeque_create_empty();
+	bytes_t *b = bytes_create_empty();
+	for (i = 0; i < 40; i++)
+		values[i] = i * 7;
+	/* make it wrap in the middle of a 32 byte stripe */
+	for (i = 29; i >= 0; i--)
+		aadeque_unshift(&a, values[i]);
+	for (i = 30; i < 40; i++)
+		aadeque_push(&a, values[i]);
+	test(a->off + a->len > a->cap, "aadeque_hash: setup");
+	aadeque_xxh64_init(&s, 42);
+	aadeque_xxh64_update(&s, values, sizeof(values));
+	test(aadeque_hash(a, 42) == aadeque_xxh64_digest(&s),
+	     "aadeque_hash: same as contiguous");
+	test(aadeque_crc32c(a) == aadeque_crc32c_update(0, values, sizeof(values)),
+	     "aadeque_crc32c: same as contiguous");
+	/* known values */
+	for (i = 99; i >= 0; i--)
+		bytes_unshift(&b, (unsigned char)i);
+	test(bytes_hash(b, 7) == 0x80653e7e9b887cddULL, "bytes_hash");
+	b = bytes_delete_first_n(b, bytes_len(b));
+	for (i = 0; i < 9; i++)
+		bytes_push(&b, (unsigned char)"123456789"[i]);
+	test(bytes_crc32c(b) == 0xe3069283, "bytes_crc32c");
+	aadeque_destroy(a);
+	bytes_destroy(b);
+}
+
+static int cmp_double(const void *x, const void *y) {
+	double a = *(const double *)x, b = *(const double *)y;
+	return a < b ? -1 : a > b;
+}
+
+void test_quantile(void) {
+	aadeque_quantile_t *t = aadeque_quantile_create();
+	double sorted[16];
+	unsigned seed = 1;
+	int i, k, ok = 1;
+	/* a window of 16 values with duplicates, compared with a sorted copy */
+	for (i = 0; i < 200; i++) {
+		seed = seed * 1103515245 + 12345;
+		aadeque_quantile_push(t, (double)((seed >> 16) % 20));
+		if (aadeque_quantile_len(t) > 16)
+			aadeque_quantile_shift(t);
+		aadeque_qwindow_copy_out(t->window, 0, t->window->len, sorted);
+		qsort(sorted, t->window->len, sizeof(double), cmp_double);
+		for (k = 0; k < (int)t->window->len; k++)
+			ok &= aadeque_quantile_kth(t, k) == sorted[k];
+	}
+	test(ok, "aadeque_quantile: kth");
+	test(aadeque_quantile_median(t) == (sorted[7] + sorted[8]) / 2 &&
+	     aadeque_quantile_get(t, 0) == sorted[0] &&
+	     aadeque_quantile_get(t, 1) == sorted[15],
+	     "aadeque_quantile: median and quantiles");
+	test(t->used <= 18, "aadeque_quantile: nodes are reused");
+	while (aadeque_quantile_len(t) > 0)
+		aadeque_quantile_shift(t);
+	test(t->root == 0, "aadeque_quantile: empty");
+	/* NaN is ordered last, and the tree stays in step with the window */
+	aadeque_quantile_push(t, 2.0);
+	aadeque_quantile_push(t, NAN);
+	aadeque_quantile_push(t, 1.0);
+	aadeque_quantile_push(t, NAN);
+	test(aadeque_quantile_kth(t, 0) == 1.0 &&
+	     aadeque_quantile_kth(t, 1) == 2.0 &&
+	     isnan(aadeque_quantile_kth(t, 2)) &&
+	     isnan(aadeque_quantile_kth(t, 3)) &&
+	     t->nodes[t->root].size == 4 && t->nodes[0].size == 0,
+	     "aadeque_quantile: NaN ordered last");
+	aadeque_quantile_shift(t);
+	aadeque_quantile_shift(t);
+	test(aadeque_quantile_kth(t, 0) == 1.0 &&
+	     isnan(aadeque_quantile_kth(t, 1)) &&
+	     t->nodes[t->root].size == 2 && t->nodes[0].size == 0,
+	     "aadeque_quantile: NaN shifted");
+	while (aadeque_quantile_len(t) > 0)
+		aadeque_quantile_shift(t);
+	test(t->root == 0 && t->nodes[0].size == 0,
+	     "aadeque_quantile: NaN empty");
+	aadeque_quantile_destroy(t);
+}
+
+void test_bucketq(void) {
+	/* Dijkstra on a ring of 10 nodes with chords, weights 1 to 3 */
+	static const int weight[10] = {3, 1, 2, 3, 1, 1, 2, 3, 2, 1};
+	uint64_t dist[10], expect[10], d;
+	struct aadeque_bucketq *q = aadeque_bucketq_create(4);
+	int i, v, changed, ok = 1;
+	/* expected distances by relaxing all edges until nothing changes */
+	for (i = 0; i < 10; i++)
+		expect[i] = i == 0 ? 0 : 1000;
+	do {
+		changed = 0;
+		for (i = 0; i < 10; i++) {
+			if (expect[i] + weight[i] < expect[(i + 1) % 10]) {
+				expect[(i + 1) % 10] = expect[i] + weight[i];
+				changed = 1;
+			}
+			if (expect[i] + 3 < expect[(i + 3) % 10]) {
+				expect[(i + 3) % 10] = expect[i] + 3;
+				changed = 1;
+			}
+		}
+	} while (changed);
+	for (i = 0; i < 10; i++)
+		dist[i] = 1000;
+	dist[0] = 0;
+	aadeque_bucketq_insert(q, 0, 0);
+	while (aadeque_bucketq_len(q) > 0) {
+		v = aadeque_bucketq_pop_min(q, &d);
+		if (d > dist[v])
+			continue;
+		/* edges v -> v+1 with weight[v] and v -> v+3 with weight 3 */
+		if (d + weight[v] < dist[(v + 1) % 10]) {
+			dist[(v + 1) % 10] = d + weight[v];
+			aadeque_bucketq_insert(q, dist[(v + 1) % 10], (v + 1) % 10);
+		}
+		if (d + 3 < dist[(v + 3) % 10]) {
+			dist[(v + 3) % 10] = d + 3;
+			aadeque_bucketq_insert(q, dist[(v + 3) % 10], (v + 3) % 10);
+		}
+	}
+	for (i = 0; i < 10; i++)
+		ok &= dist[i] == expect[i];
+	test(ok, "aadeque_bucketq: Dijkstra");
+	/* same priority: insertion order */
+	aadeque_bucketq_insert(q, 100, 1);
+	aadeque_bucketq_insert(q, 101, 3);
+	aadeque_bucketq_insert(q, 100, 2);
+	ok = aadeque_bucketq_pop_min(q, &d) == 1 && d == 100;
+	ok &= aadeque_bucketq_pop_min(q, &d) == 2 && d == 100;
+	ok &= aadeque_bucketq_pop_min(q, &d) == 3 && d == 101;
+	test(ok, "aadeque_bucketq: FIFO within a priority");
+	aadeque_bucketq_destroy(q);
+}
+
+struct timer_check {
+	aadeque_timerwheel_t *w;
+	int fired, late;
+};
+
+static void on_timer(struct aadeque_timer *t, void *ctx) {
+	struct timer_check *c = (struct timer_check *)ctx;
+	c->fired++;
+	if (t->expires != c->w->now)
+		c->late++;
+	/* reschedule one of them from the callback */
+	if (t->data == (void *)1)
+		aadeque_timerwheel_schedule(c->w, c->w->now + 1000, (void *)2);
+}
+
+void test_timerwheel(void) {
+	struct timer_check c;
+	unsigned seed = 1;
+	int i;
+	c.w = aadeque_timerwheel_create(5);
+	c.fired = c.late = 0;
+	for (i = 0; i < 1000; i++) {
+		seed = seed * 1103515245 + 12345;
+		aadeque_timerwheel_schedule(c.w, 6 + (seed >> 8) % 300000, NULL);
+	}
+	aadeque_timerwheel_schedule(c.w, 70, (void *)1);
+	aadeque_timerwheel_schedule(c.w, ((uint64_t)1 << 24) + 100, NULL);
+	test(aadeque_timerwheel_len(c.w) == 1002, "aadeque_timerwheel: schedule");
+	/* the timer at 70 is rescheduled once, to 1070 */
+	test(aadeque_timerwheel_advance(c.w, 300005, on_timer, &c) == 1002 &&
+	     c.fired == 1002 && c.late == 0 && aadeque_timerwheel_len(c.w) == 1,
+	     "aadeque_timerwheel: advance");
+	aadeque_timerwheel_advance(c.w, ((uint64_t)1 << 24) + 100, on_timer, &c);
+	test(c.fired == 1003 && c.late == 0 && aadeque_timerwheel_len(c.w) == 0,
+	     "aadeque_timerwheel: beyond the range of the wheel");
+	aadeque_timerwheel_destroy(c.w);
+}
+
+void test_config(void) {
+	test(config_kept, "Config macros kept around internal instantiations");
+	/* no seq field, since AADEQUE_HANDLES doesn't leak into them */
+	test(offsetof(struct aadeque_recends, els) == 3 * sizeof(AADEQUE_SIZE_T),
+	     "Config macros reset for internal instantiations");
+}
+
 void test_memory_clean(void) {
 	test(allocated_bytes == 0, "All allocated memory free'd");
 }
@@ -288,11 +970,31 @@ int main() {
 	test_crop();
 	test_delete_last_n();
 	test_delete_first_n();
+	test_delete_all();
 	test_slice();
+	test_fill_copy_out();
+	test_reverse_transform();
+	test_arithmetic();
+	test_each();
+	test_scan();
+	test_eq_cmp();
 	test_grow_warping();
 	test_shrink_case_1();
 	test_shrink_case_2();
 	test_shrink_case_3();
+	test_span();
+	test_handles();
+	test_multi();
+	test_pow2();
+	test_bits();
+	test_delta();
+	test_records();
+	test_frames();
+	test_hash();
+	test_bucketq();
+	test_quantile();
+	test_timerwheel();
+	test_config();
 	test_memory_clean();
 	return 0;
 }
@@ -0,0 +1,145 @@
+/*
+ * Tests for aadeque_channel.hpp:
+ *
+ *     g++ -std=c++20 -pthread test_channel.cpp -o test_channel && ./test_channel
+ */
+#include <atomic>
+#include <cstdlib>
+
+/* tweak allocation, to keep track allocated bytes */
+#define AADEQUE_ALLOC(size) test_alloc(size)
+#define AADEQUE_REALLOC(ptr, size, oldsize) test_realloc(ptr, size, oldsize)
+#define AADEQUE_FREE(ptr, size) test_free(ptr, size)
+
+static std::atomic<size_t> allocated_bytes(0);
+
+void *test_alloc(size_t size) {
+	allocated_bytes += size;
+	return malloc(size);
+}
+
+void *test_realloc(void *ptr, size_t size, size_t old_size) {
+	allocated_bytes += size - old_size;
+	return realloc(ptr, size);
+}
+
+void test_free(void *ptr, size_t size) {
+	allocated_bytes -= size;
+	free(ptr);
+}
+
+#include "aadeque_channel.hpp"
+
+#include <cstdio>
+#include <thread>
+
+void test(int cond, const char * msg) {
+	if (cond) printf("%-70s [ OK ]\n", msg);
+	else      printf("%-70s [FAIL]\n", msg);
+}
+
+using aadeque_co::task;
+
+/* a value that doesn't fit the buffer evenly */
+struct point {
+	int x, y, z;
+};
+
+template <class Channel>
+task producer(Channel &ch, int from, int n, int *sent) {
+	for (int i = from; i < from + n; i++) {
+		if (!co_await ch.send(point{i, -i, 2 * i}))
+			break;
+		(*sent)++;
+	}
+}
+
+template <class Channel>
+task consumer(Channel &ch, long *sum, int *count, bool *ordered) {
+	int last = -1;
+	for (;;) {
+		std::optional<point> p = co_await ch.recv();
+		if (!p)
+			break;
+		if (p->x <= last || p->y != -p->x || p->z != 2 * p->x)
+			*ordered = false;
+		last = p->x;
+		*sum += p->x;
+		(*count)++;
+	}
+}
+
+void test_channel_buffered(void) {
+	aadeque_co::executor ex;
+	aadeque_co::channel<point> ch(ex, 3);
+	long sum = 0;
+	int sent = 0, count = 0;
+	bool ordered = true;
+	consumer(ch, &sum, &count, &ordered);
+	producer(ch, 0, 1000, &sent);
+	test(sent < 1000 && ch.size() == 3, "channel send suspends when full");
+	ex.run();
+	test(sent == 1000 && count == 1000 && ch.size() == 0,
+	     "channel all values received");
+	test(ordered && sum == 999 * 1000 / 2, "channel values in order");
+	ch.close();
+	ex.run();
+}
+
+void test_channel_unbuffered(void) {
+	aadeque_co::executor ex;
+	aadeque_co::channel<point> ch(ex, 0);
+	long sum = 0;
+	int sent = 0, count = 0;
+	bool ordered = true;
+	producer(ch, 0, 100, &sent);
+	test(sent == 0, "channel unbuffered send waits for recv");
+	consumer(ch, &sum, &count, &ordered);
+	test(ex.run() > 0, "channel resumes in batches");
+	test(sent == 100 && count == 100 && ordered,
+	     "channel unbuffered all values received");
+	ch.close();
+	ex.run();
+	test(count == 100, "channel close ends the consumer");
+}
+
+void test_channel_close(void) {
+	aadeque_co::executor ex;
+	aadeque_co::channel<point> ch(ex, 1);
+	int sent = 0;
+	producer(ch, 0, 10, &sent);
+	ch.close();
+	ex.run();
+	test(sent == 1, "channel close fails waiting senders");
+}
+
+void test_channel_threads(void) {
+	aadeque_co::basic_executor<std::mutex> ex;
+	aadeque_co::channel<point, std::mutex> ch(ex, 8);
+	long sum = 0;
+	int sent = 0, count = 0;
+	bool ordered = true;
+	consumer(ch, &sum, &count, &ordered);
+	/* the producer starts in another thread and is resumed by the executor */
+	std::thread t([&] { producer(ch, 0, 10000, &sent); });
+	while (count < 10000)
+		ex.run();
+	t.join();
+	ch.close();
+	ex.run();
+	test(count == 10000 && ordered && sum == 9999L * 10000 / 2,
+	     "channel with std::mutex between threads");
+}
+
+void test_memory_clean(void) {
+	test(allocated_bytes == 0, "all memory freed");
+}
+
+int main() {
+	test_channel_buffered();
+	test_channel_unbuffered();
+	test_channel_close();
+	test_channel_threads();
+	test_memory_clean();
+	return 0;
+}
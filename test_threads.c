@@ -0,0 +1,645 @@
+/*
+ * Tests for the companions of aadeque.h which need C11 atomics, POSIX threads
+ * or Linux system calls:
+ *
+ *     gcc -std=c11 -pthread test_threads.c -o test_threads && ./test_threads
+ */
+#define _DEFAULT_SOURCE
+#include <stdlib.h>
+
+/* tweak allocation, to keep track allocated bytes */
+#define AADEQUE_ALLOC(size) test_alloc(size)
+#define AADEQUE_REALLOC(ptr, size, oldsize) test_realloc(ptr, size, oldsize)
+#define AADEQUE_FREE(ptr, size) test_free(ptr, size)
+
+#include <stdatomic.h>
+
+static atomic_size_t allocated_bytes;
+
+void *test_alloc(size_t size) {
+	atomic_fetch_add(&allocated_bytes, size);
+	return malloc(size);
+}
+
+void *test_realloc(void *ptr, size_t size, size_t old_size) {
+	atomic_fetch_add(&allocated_bytes, size - old_size);
+	return realloc(ptr, size);
+}
+
+void test_free(void *ptr, size_t size) {
+	atomic_fetch_sub(&allocated_bytes, size);
+	free(ptr);
+}
+
+#define AADEQUE_VALUE_T int
+#include "aadeque.h"
+#include "aadeque_shards.h"
+#include "aadeque_evq.h"
+#include "aadeque_rcu.h"
+#include "aadeque_handoff.h"
+#include "aadeque_ticket.h"
+#include "aadeque_seqlock.h"
+
+/* a deque with handles, for the seqlock ring */
+#undef AADEQUE_PREFIX
+#define AADEQUE_PREFIX hd
+#define AADEQUE_HANDLES
+#include "aadeque.h"
+#include "aadeque_seqlock.h"
+#undef AADEQUE_HANDLES
+
+#ifdef __linux__
+/* a deque of bytes, for io_uring */
+#undef AADEQUE_PREFIX
+#undef AADEQUE_VALUE_T
+#define AADEQUE_PREFIX bytes
+#define AADEQUE_VALUE_T unsigned char
+#include "aadeque.h"
+#include "aadeque_uring.h"
+#endif
+
+#include "aadeque_ws.h"
+#include "aadeque_forkjoin.h"
+
+#include <stdio.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/socket.h>
+
+void test(int cond, const char * msg) {
+	if (cond) printf("%-70s [ OK ]\n", msg);
+	else      printf("%-70s [FAIL]\n", msg);
+}
+
+/* Work-stealing deque */
+
+#define WS_N       100000
+#define WS_THIEVES 3
+
+static aadeque_ws_t *ws;
+static atomic_int ws_taken[WS_N];
+static atomic_int ws_done;
+
+static void *ws_thief(void *arg) {
+	void *v;
+	(void)arg;
+	while (!atomic_load(&ws_done))
+		if (aadeque_ws_steal(ws, &v) == AADEQUE_WS_OK)
+			atomic_fetch_add(&ws_taken[(size_t)v - 1], 1);
+	return NULL;
+}
+
+void test_ws(void) {
+	pthread_t thieves[WS_THIEVES];
+	void *v;
+	size_t i, ok = 1;
+	int r;
+	/* single-threaded: pop takes the newest, steal the oldest */
+	ws = aadeque_ws_create(2);
+	for (i = 1; i <= 5; i++)
+		aadeque_ws_push(ws, (void *)i);
+	test(aadeque_ws_len(ws) == 5, "ws push grows the buffer");
+	r = aadeque_ws_pop(ws, &v);
+	test(r == 1 && (size_t)v == 5, "ws pop takes the newest");
+	r = aadeque_ws_steal(ws, &v);
+	test(r == AADEQUE_WS_OK && (size_t)v == 1, "ws steal takes the oldest");
+	while (aadeque_ws_pop(ws, &v))
+		;
+	test(aadeque_ws_len(ws) == 0 && !aadeque_ws_pop(ws, &v) &&
+	     aadeque_ws_steal(ws, &v) == AADEQUE_WS_EMPTY, "ws empty");
+	/* the owner pushes and pops while thieves steal */
+	for (i = 0; i < WS_THIEVES; i++)
+		pthread_create(&thieves[i], NULL, ws_thief, NULL);
+	for (i = 1; i <= WS_N; i++) {
+		aadeque_ws_push(ws, (void *)i);
+		if (i % 3 == 0 && aadeque_ws_pop(ws, &v))
+			atomic_fetch_add(&ws_taken[(size_t)v - 1], 1);
+	}
+	while (aadeque_ws_pop(ws, &v))
+		atomic_fetch_add(&ws_taken[(size_t)v - 1], 1);
+	atomic_store(&ws_done, 1);
+	for (i = 0; i < WS_THIEVES; i++)
+		pthread_join(thieves[i], NULL);
+	for (i = 0; i < WS_N; i++)
+		if (atomic_load(&ws_taken[i]) != 1)
+			ok = 0;
+	test(ok, "ws each value is taken exactly once");
+	aadeque_ws_destroy(ws);
+}
+
+/* Fork-join */
+
+struct fib_task {
+	struct aadeque_fj_task task;
+	int n;
+	long result;
+};
+
+static void fib(struct aadeque_fj_task *t, struct aadeque_fj_worker *w) {
+	struct fib_task *f = (struct fib_task *)t;
+	struct fib_task a, b;
+	if (f->n < 2) {
+		f->result = f->n;
+		return;
+	}
+	a.n = f->n - 1;
+	b.n = f->n - 2;
+	aadeque_fj_fork(w, &a.task, fib);
+	fib(&b.task, w);
+	aadeque_fj_join(w, &a.task);
+	f->result = a.result + b.result;
+}
+
+void test_forkjoin(void) {
+	aadeque_fj_pool_t *p = aadeque_fj_create(4);
+	struct fib_task f;
+	f.n = 20;
+	aadeque_fj_run(p, &f.task, fib);
+	test(f.result == 6765, "forkjoin fib(20)");
+	f.n = 15;
+	aadeque_fj_run(p, &f.task, fib);
+	test(f.result == 610, "forkjoin fib(15), run again");
+	aadeque_fj_destroy(p);
+}
+
+/* Sharded queue */
+
+#define SHARDS_THREADS 4
+#define SHARDS_N       20000
+
+static struct aadeque_shards *shards;
+static atomic_int shards_taken[SHARDS_THREADS * SHARDS_N];
+static atomic_int shards_pushed;
+
+static void *shards_thread(void *arg) {
+	unsigned id = (unsigned)(size_t)arg;
+	int i, v;
+	for (i = 0; i < SHARDS_N; i++) {
+		aadeque_shards_push(shards, id, id * SHARDS_N + i);
+		if (i % 2 == 0 && aadeque_shards_shift(shards, id, &v))
+			atomic_fetch_add(&shards_taken[v], 1);
+	}
+	atomic_fetch_add(&shards_pushed, 1);
+	/* keep taking until all are pushed and the queue is drained */
+	for (;;) {
+		int done = atomic_load(&shards_pushed) == SHARDS_THREADS;
+		if (aadeque_shards_shift(shards, id, &v))
+			atomic_fetch_add(&shards_taken[v], 1);
+		else if (done)
+			break;
+	}
+	return NULL;
+}
+
+void test_shards(void) {
+	pthread_t threads[SHARDS_THREADS];
+	int i, v, ok = 1;
+	/* single-threaded: shifting from an empty shard steals half */
+	shards = aadeque_shards_create(3);
+	for (i = 0; i < 5; i++)
+		aadeque_shards_push(shards, 0, i);
+	test(aadeque_shards_len(shards) == 5, "shards push");
+	test(aadeque_shards_shift(shards, 1, &v) && v == 0,
+	     "shards shift steals from another shard");
+	test(shards->shards[1].q->len == 2 && shards->shards[0].q->len == 2,
+	     "shards steal moves half in a batch");
+	test(aadeque_shards_shift(shards, 1, &v) && v == 1 &&
+	     aadeque_shards_shift(shards, 1, &v) && v == 2,
+	     "shards stolen elements are in order");
+	for (i = 0; i < 2; i++)
+		aadeque_shards_shift(shards, 2, &v);
+	test(aadeque_shards_len(shards) == 0 &&
+	     !aadeque_shards_shift(shards, 2, &v), "shards empty");
+	aadeque_shards_destroy(shards);
+	/* concurrent, one shard per thread */
+	shards = aadeque_shards_create(SHARDS_THREADS);
+	for (i = 0; i < SHARDS_THREADS; i++)
+		pthread_create(&threads[i], NULL, shards_thread, (void *)(size_t)i);
+	for (i = 0; i < SHARDS_THREADS; i++)
+		pthread_join(threads[i], NULL);
+	for (i = 0; i < SHARDS_THREADS * SHARDS_N; i++)
+		if (atomic_load(&shards_taken[i]) != 1)
+			ok = 0;
+	test(ok, "shards each value is taken exactly once");
+	aadeque_shards_destroy(shards);
+}
+
+/* Pollable queue */
+
+#define EVQ_N 100000
+
+static struct aadeque_evq *evq;
+
+static int readable(int fd, int timeout) {
+	struct pollfd p;
+	p.fd = fd;
+	p.events = POLLIN;
+	return poll(&p, 1, timeout) == 1;
+}
+
+static void *evq_producer(void *arg) {
+	int i;
+	(void)arg;
+	for (i = 0; i < EVQ_N; i++)
+		aadeque_evq_push(evq, i);
+	return NULL;
+}
+
+void test_evq(void) {
+	struct aadeque *batch = aadeque_create_empty();
+	pthread_t producer;
+	long sum = 0;
+	int n = 0;
+	evq = aadeque_evq_create();
+	test(evq && !readable(aadeque_evq_fd(evq), 0), "evq empty, not readable");
+	aadeque_evq_push(evq, 1);
+	aadeque_evq_push(evq, 2);
+	aadeque_evq_push(evq, 3);
+	test(readable(aadeque_evq_fd(evq), 0), "evq readable after push");
+#ifdef __linux__
+	{
+		uint64_t count = 0;
+		ssize_t r = read(aadeque_evq_fd(evq), &count, sizeof(count));
+		test(r == sizeof(count) && count == 1,
+		     "evq signaled once for several pushes");
+	}
+#endif
+	test(aadeque_evq_drain(evq, &batch) == 3 && aadeque_get(batch, 0) == 1 &&
+	     aadeque_get(batch, 2) == 3, "evq drain takes all in a batch");
+	test(!readable(aadeque_evq_fd(evq), 0), "evq not readable after drain");
+	aadeque_delete_all(batch);
+	/* a producer thread and an event loop */
+	pthread_create(&producer, NULL, evq_producer, NULL);
+	while (n < EVQ_N) {
+		AADEQUE_SIZE_T i;
+		readable(aadeque_evq_fd(evq), -1);
+		n += aadeque_evq_drain(evq, &batch);
+		for (i = 0; i < batch->len; i++)
+			sum += aadeque_get(batch, i);
+		aadeque_delete_all(batch);
+	}
+	pthread_join(producer, NULL);
+	test(n == EVQ_N && sum == (long)EVQ_N * (EVQ_N - 1) / 2,
+	     "evq event loop receives all values");
+	aadeque_destroy(batch);
+	aadeque_evq_destroy(evq);
+}
+
+/* Snapshots */
+
+#define RCU_READERS 3
+#define RCU_N       20000
+#define RCU_BATCH   10
+
+static struct aadeque_rcu *rcu;
+static atomic_int rcu_done;
+static atomic_int rcu_consistent = 1;
+
+static void *rcu_reader(void *arg) {
+	int slot = aadeque_rcu_register(rcu);
+	uint64_t last = 0;
+	(void)arg;
+	while (!atomic_load(&rcu_done)) {
+		struct aadeque_snapshot *s = aadeque_rcu_read_lock(rcu, slot);
+		AADEQUE_SIZE_T i, n = s->a->len;
+		/* the writer keeps a window of consecutive numbers */
+		for (i = 1; i < n; i++)
+			if (aadeque_get(s->a, i) != aadeque_get(s->a, i - 1) + 1)
+				atomic_store(&rcu_consistent, 0);
+		/* after the first two, a version is published per batch */
+		if (s->version < last ||
+		    (s->version >= 2 && aadeque_get(s->a, n - 1) !=
+		     1 + ((int)s->version - 2) * RCU_BATCH))
+			atomic_store(&rcu_consistent, 0);
+		last = s->version;
+		aadeque_rcu_read_unlock(rcu, slot);
+	}
+	aadeque_rcu_unregister(rcu, slot);
+	return NULL;
+}
+
+void test_rcu(void) {
+	pthread_t readers[RCU_READERS];
+	struct aadeque_snapshot *s;
+	int i, slot;
+	rcu = aadeque_rcu_create();
+	slot = aadeque_rcu_register(rcu);
+	aadeque_push(aadeque_rcu_writer(rcu), 0);
+	s = aadeque_rcu_read_lock(rcu, slot);
+	test(s->version == 0 && s->a->len == 0, "rcu unpublished update not seen");
+	aadeque_rcu_read_unlock(rcu, slot);
+	test(aadeque_rcu_publish(rcu) == 1, "rcu publish returns version");
+	s = aadeque_rcu_read_lock(rcu, slot);
+	aadeque_push(aadeque_rcu_writer(rcu), 1);
+	aadeque_rcu_publish(rcu);
+	test(s->version == 1 && s->a->len == 1 && aadeque_get(s->a, 0) == 0,
+	     "rcu snapshot unchanged while read");
+	aadeque_rcu_read_unlock(rcu, slot);
+	aadeque_rcu_unregister(rcu, slot);
+	/* one writer, publishing once per batch, and concurrent readers */
+	for (i = 0; i < RCU_READERS; i++)
+		pthread_create(&readers[i], NULL, rcu_reader, NULL);
+	for (i = 2; i <= RCU_N; i++) {
+		aadeque_push(aadeque_rcu_writer(rcu), i);
+		if (aadeque_len(*aadeque_rcu_writer(rcu)) > 100)
+			aadeque_shift(aadeque_rcu_writer(rcu));
+		if ((i - 1) % RCU_BATCH == 0)
+			aadeque_rcu_publish(rcu);
+	}
+	atomic_store(&rcu_done, 1);
+	for (i = 0; i < RCU_READERS; i++)
+		pthread_join(readers[i], NULL);
+	test(atomic_load(&rcu_consistent), "rcu readers see consistent snapshots");
+	/* with no readers, all but the snapshot just replaced are reclaimed */
+	aadeque_rcu_publish(rcu);
+	test(rcu->retired != NULL && rcu->retired->next == NULL,
+	     "rcu replaced snapshots are reclaimed");
+	aadeque_rcu_destroy(rcu);
+}
+
+/* double-buffered handoff */
+
+#define HANDOFF_N 100000
+
+static struct aadeque_handoff *handoff;
+
+static void *handoff_producer(void *arg) {
+	int i, vals[10];
+	(void)arg;
+	for (i = 0; i < HANDOFF_N; i += 10) {
+		int j;
+		for (j = 0; j < 10; j++)
+			vals[j] = i + j;
+		if (i % 20)
+			aadeque_handoff_push_n(handoff, vals, 10);
+		else
+			for (j = 0; j < 10; j++)
+				aadeque_handoff_push(handoff, vals[j]);
+		aadeque_handoff_publish(handoff);
+	}
+	/* the rest, when the consumer has taken the previous batch */
+	while (!aadeque_handoff_publish(handoff))
+		sched_yield();
+	return NULL;
+}
+
+void test_handoff(void) {
+	pthread_t producer;
+	struct aadeque *batch, *first;
+	int vals[] = {1, 2, 3}, next = 0, ordered = 1;
+	AADEQUE_SIZE_T cap;
+	handoff = aadeque_handoff_create();
+	test(aadeque_handoff_swap(handoff) == NULL, "handoff swap when empty");
+	aadeque_handoff_push(handoff, 0);
+	aadeque_handoff_push_n(handoff, vals, 3);
+	test(aadeque_handoff_swap(handoff) == NULL,
+	     "handoff unpublished values not taken");
+	test(aadeque_handoff_publish(handoff) == 1, "handoff publish");
+	aadeque_handoff_push(handoff, 4);
+	test(aadeque_handoff_publish(handoff) == 0,
+	     "handoff publish when the previous batch isn't taken");
+	first = batch = aadeque_handoff_swap(handoff);
+	test(batch != NULL && batch->len == 4 && aadeque_get(batch, 0) == 0 &&
+	     aadeque_get(batch, 3) == 3, "handoff swap takes the batch");
+	cap = batch->cap;
+	test(aadeque_handoff_swap(handoff) == NULL, "handoff swap only once");
+	test(aadeque_handoff_publish(handoff) == 1, "handoff publish later");
+	batch = aadeque_handoff_swap(handoff);
+	test(batch != NULL && batch->len == 1 && aadeque_get(batch, 0) == 4,
+	     "handoff values kept until published");
+	aadeque_handoff_push(handoff, 5);
+	aadeque_handoff_publish(handoff);
+	test(handoff->front == first && first->len == 0 && first->cap == cap,
+	     "handoff batch emptied with capacity kept");
+	aadeque_handoff_destroy(handoff);
+	/* one producer and one consumer */
+	handoff = aadeque_handoff_create();
+	pthread_create(&producer, NULL, handoff_producer, NULL);
+	while (next < HANDOFF_N) {
+		AADEQUE_SIZE_T i;
+		batch = aadeque_handoff_swap(handoff);
+		if (!batch)
+			continue;
+		for (i = 0; i < batch->len; i++)
+			if (aadeque_get(batch, i) != next++)
+				ordered = 0;
+	}
+	pthread_join(producer, NULL);
+	test(ordered && next == HANDOFF_N, "handoff concurrent values in order");
+	aadeque_handoff_destroy(handoff);
+}
+
+/* ticketed batch append */
+
+#define TICKET_PRODUCERS 4
+#define TICKET_N 20000
+
+static struct aadeque_ticket *ticket;
+
+static void *ticket_producer(void *arg) {
+	int id = (int)(size_t)arg, i = 0, vals[64];
+	while (i < TICKET_N) {
+		int j, n = 1 + (i * 7 + id) % 64;
+		if (n > TICKET_N - i)
+			n = TICKET_N - i;
+		for (j = 0; j < n; j++)
+			vals[j] = id << 24 | (i + j);
+		aadeque_ticket_push_n(ticket, vals, n);
+		i += n;
+	}
+	return NULL;
+}
+
+void test_ticket(void) {
+	pthread_t producers[TICKET_PRODUCERS];
+	int vals[] = {1, 2, 3, 4, 5}, out[8], next[TICKET_PRODUCERS] = {0};
+	int i, total = 0, ordered = 1;
+	size_t t1, t2;
+	ticket = aadeque_ticket_create(6);
+	test(ticket->cap == 8, "ticket capacity rounded up to power of 2");
+	t1 = aadeque_ticket_reserve(ticket, 2);
+	t2 = aadeque_ticket_reserve(ticket, 3);
+	test(t1 == 0 && t2 == 2, "ticket reserve returns consecutive tickets");
+	test(aadeque_ticket_reserve(ticket, 9) == AADEQUE_TICKET_NONE &&
+	     aadeque_ticket_push_n(ticket, out, 9) == 0,
+	     "ticket run larger than the capacity rejected");
+	aadeque_ticket_put(ticket, t2, vals + 2, 3);
+	aadeque_ticket_put(ticket, t1, vals, 2);
+	test(aadeque_ticket_len(ticket) == 0 &&
+	     aadeque_ticket_take(ticket, out, 8) == 0,
+	     "ticket uncommitted values not seen");
+	aadeque_ticket_commit(ticket, t1, 2);
+	test(aadeque_ticket_take(ticket, out, 8) == 2 && out[0] == 1 && out[1] == 2,
+	     "ticket committed values taken");
+	aadeque_ticket_commit(ticket, t2, 3);
+	aadeque_ticket_push_n(ticket, vals, 5);
+	/* the rejected runs took no tickets */
+	test(aadeque_ticket_len(ticket) == 8, "ticket push wrapped around");
+	test(aadeque_ticket_take(ticket, out, 8) == 8 && out[2] == 5 &&
+	     out[3] == 1 && out[7] == 5,
+	     "ticket take wrapped around");
+	aadeque_ticket_destroy(ticket);
+	/* many producers and one consumer */
+	ticket = aadeque_ticket_create(256);
+	for (i = 0; i < TICKET_PRODUCERS; i++)
+		pthread_create(&producers[i], NULL, ticket_producer, (void *)(size_t)i);
+	while (total < TICKET_PRODUCERS * TICKET_N) {
+		int buf[100];
+		AADEQUE_SIZE_T j, n = aadeque_ticket_take(ticket, buf, 100);
+		for (j = 0; j < n; j++) {
+			int id = buf[j] >> 24;
+			if ((buf[j] & 0xffffff) != next[id]++)
+				ordered = 0;
+		}
+		total += n;
+		if (n == 0)
+			sched_yield();
+	}
+	for (i = 0; i < TICKET_PRODUCERS; i++)
+		pthread_join(producers[i], NULL);
+	test(ordered, "ticket concurrent batches in order");
+	aadeque_ticket_destroy(ticket);
+}
+
+/* seqlock ring */
+
+#define SEQRING_READERS 3
+#define SEQRING_N 100000
+
+static struct aadeque_seqring *seqring;
+static atomic_int seqring_done, seqring_consistent = 1;
+
+static void *seqring_reader(void *arg) {
+	int buf[8];
+	(void)arg;
+	while (!atomic_load(&seqring_done)) {
+		AADEQUE_SIZE_T i, n = aadeque_seqring_read_last(seqring, buf, 8);
+		for (i = 1; i < n; i++)
+			if (buf[i] != buf[i - 1] + 1)
+				atomic_store(&seqring_consistent, 0);
+	}
+	return NULL;
+}
+
+void test_seqring(void) {
+	pthread_t readers[SEQRING_READERS];
+	int i, buf[10];
+	seqring = aadeque_seqring_create(4);
+	test(aadeque_seqring_read_last(seqring, buf, 10) == 0,
+	     "seqring read when empty");
+	for (i = 1; i <= 6; i++)
+		aadeque_seqring_push(seqring, i);
+	test(aadeque_seqring_read_last(seqring, buf, 3) == 3 && buf[0] == 4 &&
+	     buf[2] == 6, "seqring read last values");
+	test(aadeque_seqring_read_last(seqring, buf, 10) == 4 && buf[0] == 3 &&
+	     buf[3] == 6 && seqring->a->cap == 4,
+	     "seqring full ring overwrites oldest");
+	aadeque_seqring_destroy(seqring);
+	{
+		/* a handle to the value 3 follows it when older ones are overwritten */
+		struct hd_seqring *r = hd_seqring_create(4);
+		struct hd_handle h;
+		AADEQUE_SIZE_T j;
+		for (i = 1; i <= 6; i++)
+			hd_seqring_push(r, i);
+		h = hd_handle(&r->a, 0);
+		hd_seqring_push(r, 7);
+		test(!hd_handle_index(h, &j), "seqring handle to overwritten value");
+		h = hd_handle(&r->a, 1);
+		hd_seqring_push(r, 8);
+		test(hd_handle_index(h, &j) && j == 0 && *hd_resolve(h) == 5,
+		     "seqring handles kept on overwrite");
+		hd_seqring_destroy(r);
+	}
+#ifndef __SANITIZE_THREAD__
+	/* one writer and concurrent readers; racy copies by design */
+	seqring = aadeque_seqring_create(16);
+	for (i = 0; i < SEQRING_READERS; i++)
+		pthread_create(&readers[i], NULL, seqring_reader, NULL);
+	for (i = 0; i < SEQRING_N; i++)
+		aadeque_seqring_push(seqring, i);
+	atomic_store(&seqring_done, 1);
+	for (i = 0; i < SEQRING_READERS; i++)
+		pthread_join(readers[i], NULL);
+	test(atomic_load(&seqring_consistent),
+	     "seqring readers see consistent windows");
+	aadeque_seqring_destroy(seqring);
+#else
+	(void)readers;
+#endif
+}
+
+/* io_uring */
+
+#ifdef __linux__
+void test_uring(void) {
+	struct aadeque_uring ring;
+	struct bytes_io in, out;
+	struct io_uring_cqe cqe;
+	int fds[2], i, nread = 0, nwritten = 0;
+	if (aadeque_uring_init(&ring, 8) < 0) {
+		printf("%-70s [SKIP]\n", "uring not available");
+		return;
+	}
+	socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+	/* out contains "defghijk", wrapped around the end of the buffer */
+	out.a = bytes_create_empty();
+	out.reading = out.writing = 0;
+	for (i = 0; i < 8; i++)
+		bytes_push(&out.a, 'a' + i);
+	for (i = 0; i < 3; i++)
+		bytes_shift(&out.a);
+	for (i = 8; i < 11; i++)
+		bytes_push(&out.a, 'a' + i);
+	/* in contains "xy", with the free space wrapped around */
+	in.a = bytes_create_empty();
+	in.reading = in.writing = 0;
+	for (i = 0; i < 4; i++)
+		bytes_push(&in.a, 'x' + (i % 2));
+	for (i = 0; i < 2; i++)
+		bytes_shift(&in.a);
+	test(out.a->off + out.a->len > out.a->cap && in.a->off == 2 &&
+	     in.a->cap == 4,
+	     "uring test buffers wrap around");
+	test(bytes_io_write(&ring, &out, fds[0], 1) == 8 && out.wiov[1].iov_len,
+	     "uring write queued with two iovecs");
+	test(bytes_io_read(&ring, &in, fds[1], 6, 2) == 6 && in.riov[1].iov_len,
+	     "uring read queued with two iovecs");
+	test(aadeque_uring_submit(&ring, 2) == 2, "uring submit two in one call");
+	while (aadeque_uring_next(&ring, &cqe)) {
+		if (cqe.user_data == 1)
+			nwritten = bytes_io_write_done(&out, cqe.res);
+		else
+			nread = bytes_io_read_done(&in, cqe.res);
+	}
+	test(nwritten == 8 && out.a->len == 0, "uring write done deletes bytes");
+	test(nread == 6 && in.a->len == 8 && bytes_get(in.a, 0) == 'x' &&
+	     bytes_get(in.a, 2) == 'd' && bytes_get(in.a, 7) == 'i',
+	     "uring read done adds bytes");
+	close(fds[0]);
+	close(fds[1]);
+	bytes_destroy(in.a);
+	bytes_destroy(out.a);
+	aadeque_uring_exit(&ring);
+}
+#endif
+
+void test_memory_clean(void) {
+	test(atomic_load(&allocated_bytes) == 0, "all memory freed");
+}
+
+int main() {
+	test_ws();
+	test_forkjoin();
+	test_shards();
+	test_evq();
+	test_rcu();
+	test_handoff();
+	test_ticket();
+	test_seqring();
+#ifdef __linux__
+	test_uring();
+#endif
+	test_memory_clean();
+	return 0;
+}